@@ -1,32 +1,202 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "cache.h"
-#include "main.h"
+#include "trace.h"
+#include "prof.h"
+#include "protocol.h"
+#include "hier.h"
+#include "timing.h"
+#include "classify.h"
+#include "hot.h"
+#include "repl.h"
+#include "prefetch.h"
+#include "wbuf.h"
+
+/* Everything below except the debug log is per thread, so that the shard
+   workers of the parallel engine each run their own cache_context, and so
+   does every thread driving a cachesim handle. So is the state of the
+   lower levels, timing, classification, hot blocks, prefetchers and write
+   buffers, which a cache_context carries along. The main thread sees
+   ordinary globals. */
 
 /* cache configuration parameters */
-static int cache_usize = DEFAULT_CACHE_SIZE;
-static int cache_block_size = DEFAULT_CACHE_BLOCK_SIZE;
-static int words_per_block = DEFAULT_CACHE_BLOCK_SIZE / WORD_SIZE;
-static int cache_assoc = DEFAULT_CACHE_ASSOC;
-static int cache_writeback = DEFAULT_CACHE_WRITEBACK;
-static int cache_writealloc = DEFAULT_CACHE_WRITEALLOC;
-static int num_core = DEFAULT_NUM_CORE;
-
-/* cache model data structures */
-/* max of 8 cores */
-static cache mesi_cache[8];
-static cache_stat mesi_cache_stat[8];
-static int debug = DEFAULT_DEBUG;
-static int ref_count = 0;
-static FILE *cacheLog;
+static __thread int cache_usize = DEFAULT_CACHE_SIZE;
+static __thread int cache_block_size = DEFAULT_CACHE_BLOCK_SIZE;
+static __thread int words_per_block = DEFAULT_CACHE_BLOCK_SIZE / WORD_SIZE;
+static __thread int cache_assoc = DEFAULT_CACHE_ASSOC;
+static __thread int cache_writeback = DEFAULT_CACHE_WRITEBACK;
+static __thread int cache_writealloc = DEFAULT_CACHE_WRITEALLOC;
+static __thread int num_core = DEFAULT_NUM_CORE;
+
+/* cache model data structures, one per core */
+static __thread Pcache mesi_cache;
+static __thread Pcache_stat mesi_cache_stat;
+#ifdef CACHE_DEBUG
+static __thread int debug = DEFAULT_DEBUG;
+#else
+#define debug FALSE	/* tracing is compiled out, see "make sim-debug" */
+#endif
+static __thread long long ref_count = 0;
+static FILE *cacheLog;			/* opened by the first model to trace */
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* snoop filter: open addressing table with one slot per block held valid
+   by at least one core, and a num_core bit sharer bitmap per slot */
+static __thread int snoop_filter = DEFAULT_SNOOP_FILTER;
+static __thread unsigned long long *dir_blocks;	/* block address (addr >> block offset) */
+static __thread int *dir_count;		/* number of sharers, 0 for a free slot */
+static __thread unsigned long long *dir_bits;	/* sharer_words bitmap words per slot */
+static __thread unsigned dir_mask;		/* directory size - 1 */
+static __thread int sharer_words;		/* 64 bit words per sharer bitmap */
+static __thread unsigned long long *sharers;	/* BroadcastnSearch copy of a bitmap */
+
+/* geometries of the cores named by -cores, the others take -us, -a and
+   -bs. uniform is set while every core has the same geometry. */
+typedef struct core_group_ {
+  int first, last;
+  int usize, assoc, block_size;
+} core_group;
+static __thread core_group groups[MAX_CORE_GROUPS];
+static __thread int n_groups;
+static __thread int uniform = TRUE;
+static __thread int max_sets;			/* sets of the largest core */
+
+/* access kernels chosen by init_cache() for the configured geometry */
+static __thread access_fn access_kernel;
+static __thread batch_fn batch_kernel;
+static void access_generic(unsigned long long addr, unsigned access_type, unsigned pid);
+static void batch_generic(trace_record *rec, int n);
+
+/* coherence protocol, see protocol.c */
+static __thread int protocol_id = DEFAULT_PROTOCOL;
+static __thread const protocol *proto = &protocols[DEFAULT_PROTOCOL];
+
+/* replacement policy of the private caches, see repl.c */
+static __thread int repl_policy = DEFAULT_REPL;
+
+/* levels below the private caches, see hier.c; sizes of 0 leave them out */
+static __thread int l2_usize, l2_assoc = DEFAULT_L2_ASSOC;
+static __thread int llc_usize, llc_assoc = DEFAULT_LLC_ASSOC;
+static __thread int llc_policy = DEFAULT_LLC_POLICY;
+static __thread int hierarchy = FALSE;
+static __thread hier_context *hier_model;
+
+/* bus and latency model, see timing.c */
+static __thread int lat[N_LATENCIES] = { DEFAULT_LAT_HIT, DEFAULT_LAT_C2C, DEFAULT_LAT_MEM,
+                                         DEFAULT_LAT_L2, DEFAULT_LAT_LLC };
+static __thread int bus_width = DEFAULT_BUS_WIDTH, bus_arb = DEFAULT_BUS_ARB;
+static __thread int timing = FALSE;
+static __thread timing_context *timing_model;
+
+/* miss classification, see classify.c; CLASSIFY_SEEN only records which
+   cores referenced each block, see set_phase() */
+#define CLASSIFY_SEEN 2
+static __thread int classify = FALSE;
+static __thread classify_context *classify_model;
+
+/* hot block report, see hot.c */
+static __thread int hot_k;
+static __thread int hot = FALSE;
+static __thread hot_context *hot_model;
+
+/* the models set_phase() suspends, as the options enabled them */
+static __thread int phase = PHASE_MEASURE;
+static __thread int enabled_timing, enabled_classify, enabled_hot;
+
+/* prefetchers, see prefetch.c; prefetch_issue is set while a prefetch
+   broadcasts and fills */
+static __thread int prefetch_kind = PREFETCH_NONE, prefetch_degree = DEFAULT_PREFETCH_DEGREE;
+static __thread int prefetcher = FALSE;
+static __thread int prefetch_issue = FALSE;
+static __thread prefetch_context *prefetch_model;
+
+/* write buffers for the stores -wt and -nw send to memory, see wbuf.c */
+static __thread int wbuf_entries;
+static __thread int wbuf = FALSE;
+static __thread wbuf_context *wbuf_model;
+
+/* Where the cache of c holds addr. The index takes the low set_bits bits
+   above the block offset, so a set count that is not a power of two uses
+   only its first 1 << set_bits sets. Every lookup goes through these, the
+   kernels passing block_bits as a constant. */
+#define ADDR_INDEX(c, addr, block_bits) ((unsigned)(((addr) & (c)->index_mask) >> (block_bits)))
+#define ADDR_TAG(c, addr) ((addr) >> (c)->tag_shift)
+
+/* block number of line (tag, index), and back */
+#define BLOCK_OF(c, tag, index) (((unsigned long long)(tag) << (c)->set_bits) | (index))
+#define BLOCK_INDEX(c, block) ADDR_INDEX(c, (block) << (c)->index_mask_offset, (c)->index_mask_offset)
+#define BLOCK_TAG(c, block) ((block) >> (c)->set_bits)
 
 /************************************************************/
+/* returns why value cannot be given to param, NULL if it can */
+char *cache_param_error(int param, int value)
+{
+  switch (param) {
+  case NUM_CORE:
+    if (value < 1) return "number of cores must be positive";
+    break;
+  case CACHE_PARAM_ASSOC:
+    if (value < 1) return "associativity must be positive";
+    break;
+  case PARAM_DEBUG:
+#ifndef CACHE_DEBUG
+    return "-dg needs the debug build, run \"make sim-debug\"";
+#endif
+    break;
+  case PARAM_PROTOCOL:
+    if (value < 0 || value >= N_PROTOCOLS) return "unknown coherence protocol";
+    break;
+  case PARAM_REPL:
+    if (value < 0 || value >= N_REPL_POLICIES) return "unknown replacement policy";
+    break;
+  case PARAM_LLC_POLICY:
+    if (value < LLC_INCLUSIVE || value > LLC_NINE) return "unknown LLC policy";
+    break;
+  case PARAM_HOT:
+    if (value < 1) return "hot block count must be positive";
+    break;
+  case PARAM_PREFETCH:
+    if (value < PREFETCH_NONE || value > PREFETCH_STREAM) return "unknown prefetcher";
+    break;
+  case PARAM_PREFETCH_DEGREE:
+    if (value < 1) return "prefetch degree must be positive";
+    break;
+  case PARAM_WBUF:
+    if (value < 1) return "write buffer entries must be positive";
+    break;
+  case PARAM_LAT_HIT:
+  case PARAM_LAT_C2C:
+  case PARAM_LAT_MEM:
+  case PARAM_LAT_L2:
+  case PARAM_LAT_LLC:
+    if (value < 0) return "latencies cannot be negative";
+    break;
+  case PARAM_BUS_WIDTH:
+    if (value < 1) return "bus width must be positive";
+    break;
+  case PARAM_BUS_ARB:
+    if (value < 0) return "bus arbitration cannot be negative";
+    break;
+  default:
+    if (param < 0 || param >= N_PARAMS) return "bad parameter value";
+  }
+  return NULL;
+}
+
 void set_cache_param(param, value)
   int param;
   int value;
 {
+  char *msg = cache_param_error(param, value);
+
+  if (msg != NULL) {
+    printf("error set_cache_param: %s\n", msg);
+    exit(-1);
+  }
   switch (param) {
   case NUM_CORE:
     num_core = value;
@@ -42,21 +212,210 @@ void set_cache_param(param, value)
     cache_assoc = value;
     break;
   case PARAM_DEBUG:
+#ifdef CACHE_DEBUG
     debug = TRUE;
+#endif
     break;
-  default:
-    printf("error set_cache_param: bad parameter value\n");
+  case PARAM_SNOOP_FILTER:
+    snoop_filter = TRUE;
+    break;
+  case PARAM_PROTOCOL:
+    protocol_id = value;
+    proto = &protocols[value];
+    break;
+  case PARAM_REPL:
+    repl_policy = value;
+    break;
+  case PARAM_L2_USIZE:
+    l2_usize = value;
+    break;
+  case PARAM_L2_ASSOC:
+    l2_assoc = value;
+    break;
+  case PARAM_LLC_USIZE:
+    llc_usize = value;
+    break;
+  case PARAM_LLC_ASSOC:
+    llc_assoc = value;
+    break;
+  case PARAM_LLC_POLICY:
+    llc_policy = value;
+    break;
+  case PARAM_TIMING:
+    timing = TRUE;
+    break;
+  case PARAM_CLASSIFY:
+    classify = TRUE;
+    break;
+  case PARAM_HOT:
+    hot_k = value;
+    hot = TRUE;
+    break;
+  case PARAM_PREFETCH:
+    prefetch_kind = value;
+    prefetcher = value != PREFETCH_NONE;
+    break;
+  case PARAM_PREFETCH_DEGREE:
+    prefetch_degree = value;
+    break;
+  case CACHE_PARAM_WRITEBACK:
+    cache_writeback = TRUE;
+    break;
+  case CACHE_PARAM_WRITETHROUGH:
+    cache_writeback = FALSE;
+    break;
+  case CACHE_PARAM_WRITEALLOC:
+    cache_writealloc = TRUE;
+    break;
+  case CACHE_PARAM_NOWRITEALLOC:
+    cache_writealloc = FALSE;
+    break;
+  case PARAM_WBUF:
+    wbuf_entries = value;
+    wbuf = TRUE;
+    break;
+  case PARAM_LAT_HIT:
+  case PARAM_LAT_C2C:
+  case PARAM_LAT_MEM:
+  case PARAM_LAT_L2:
+  case PARAM_LAT_LLC:
+    lat[param - PARAM_LAT_HIT] = value;
+    break;
+  case PARAM_BUS_WIDTH:
+    bus_width = value;
+    break;
+  case PARAM_BUS_ARB:
+    bus_arb = value;
+    break;
+  }
+}
+/************************************************************/
+
+/* returns why set_core_geometry() cannot take these values, NULL if it can */
+char *core_group_error(int first, int last, int usize, int assoc, int block_size)
+{
+  if (first < 0 || last < first || usize < 1 || assoc < 1 || block_size < 1)
+    return "bad parameter value";
+  return NULL;
+}
+
+/* gives cores first .. last their own size, associativity and block size */
+void set_core_geometry(int first, int last, int usize, int assoc, int block_size)
+{
+  char *msg = core_group_error(first, last, usize, assoc, block_size);
+
+  if (n_groups == MAX_CORE_GROUPS) {
+    printf("error set_core_geometry: at most %d core groups\n", MAX_CORE_GROUPS);
     exit(-1);
   }
+  if (msg != NULL) {
+    printf("error set_core_geometry: %s\n", msg);
+    exit(-1);
+  }
+  groups[n_groups].first = first;
+  groups[n_groups].last = last;
+  groups[n_groups].usize = usize;
+  groups[n_groups].assoc = assoc;
+  groups[n_groups].block_size = block_size;
+  n_groups++;
 }
 /************************************************************/
 
 /************************************************************/
+/* returns why a core geometry cannot be simulated, NULL if it can */
+static char *geometry_error(int usize, int assoc, int block_size)
+{
+  static __thread char error_text[100];
+
+  //LRU ranks are kept in a byte per line, with EMPTY_RANK marking unused ways
+  if(assoc > 255) return "associativity above 255 is not supported";
+  if(block_size < WORD_SIZE)
+  {
+     snprintf(error_text, sizeof(error_text), "block size must be at least %d bytes", WORD_SIZE);
+     return error_text;
+  }
+  if(usize/block_size/assoc < 1)
+  {
+     snprintf(error_text, sizeof(error_text), "cache of %d bytes cannot hold one %d-way set of %d byte blocks", usize, assoc, block_size);
+     return error_text;
+  }
+  return NULL;
+}
+
+/* core pid takes the geometry of the last group naming it, if any */
+static void core_geometry(int pid, int *usize, int *assoc, int *block_size)
+{
+  int g;
+
+  *usize = cache_usize;
+  *assoc = cache_assoc;
+  *block_size = cache_block_size;
+  for(g = 0; g < n_groups; g++)
+     if(pid >= groups[g].first && pid <= groups[g].last)
+     {
+        *usize = groups[g].usize;
+        *assoc = groups[g].assoc;
+        *block_size = groups[g].block_size;
+     }
+}
+
+/* returns why the parameters set on this thread cannot be simulated, NULL
+   if they can. init_cache() exits with it, a cachesim handle returns it. */
+char *config_error()
+{
+  static __thread char error_text[100];
+  int i, g, usize, assoc, block_size, offset, min_offset = -1, max_offset = -1;
+  char *msg;
+
+  if((msg = geometry_error(cache_usize, cache_assoc, cache_block_size)) != NULL) return msg;
+  for(g = 0; g < n_groups; g++)
+     if(groups[g].last >= num_core)
+     {
+        snprintf(error_text, sizeof(error_text), "-cores %d-%d names a core beyond the %d simulated", groups[g].first, groups[g].last, num_core);
+        return error_text;
+     }
+  for(i = 0; i < num_core; i++)
+  {
+     core_geometry(i, &usize, &assoc, &block_size);
+     if((msg = geometry_error(usize, assoc, block_size)) != NULL) return msg;
+     if((msg = repl_error(assoc, repl_policy)) != NULL) return msg;
+     offset = LOG2(block_size);
+     if(min_offset < 0 || offset < min_offset) min_offset = offset;
+     if(offset > max_offset) max_offset = offset;
+  }
+
+  //The models below the private caches, and the ones that follow blocks
+  //through them, assume a single block size
+  if(min_offset != max_offset && (timing || l2_usize || llc_usize || classify || hot || prefetcher || wbuf))
+     return "cores with different block sizes cannot be combined with -timing, -l2, -llc, -classify, -hot, -prefetch or -wbuf";
+  if((l2_usize || llc_usize) && (!cache_writeback || !cache_writealloc))
+     return "-l2 and -llc cannot be combined with -wt or -nw";
+  if(wbuf && cache_writeback && cache_writealloc)
+     return "-wbuf needs -wt or -nw";
+  core_geometry(0, &usize, &assoc, &block_size);
+  if((l2_usize || llc_usize) && (msg = hier_error(l2_usize, l2_assoc, llc_usize, llc_assoc, block_size)) != NULL) return msg;
+  if(wbuf && (msg = wbuf_error(block_size)) != NULL) return msg;
+  return NULL;
+}
+
+/* allocates the state of one of the models of the other modules */
+static void *model(size_t size)
+{
+  void *p = calloc(1, size);
+
+  if(p == NULL) {printf("error : Memory allocation failed for the models\n"); exit(-1);}
+  return p;
+}
+
 void init_cache()
 {
+  //Every traced model writes to the one log
   if(debug)
   {
-     cacheLog = fopen("cache.log", "w");
+     pthread_mutex_lock(&log_lock);
+     if(cacheLog == NULL)
+        cacheLog = fopen("cache.log", "w");
+     pthread_mutex_unlock(&log_lock);
      if(cacheLog == NULL) {printf("error : Unable to create cache.log file\n"); exit(-1);}
   }
 
@@ -64,29 +423,56 @@ void init_cache()
 
   //Initialize the caches - depending on the number of cores present
   //All core caches are identical
-  int n_blocks, n_sets, mask_size, block_offset, mask, i, j;
+  int n_blocks, n_sets, mask_size, block_offset, i, j, n_lines;
+  int usize, assoc, block_size, min_offset, max_lines;
+  int *lines;
+  long granules;
+  unsigned long long mask;
+  char *msg;
 
+  msg = config_error();
+  if(msg != NULL) {printf("error : %s\n", msg); exit(-1);}
   n_blocks = cache_usize/cache_block_size;
   n_sets = n_blocks/cache_assoc;
   block_offset = LOG2(cache_block_size);
   mask_size = LOG2(n_sets) + block_offset;
-  mask = (1<<mask_size) - 1;
+  mask = (1ULL<<mask_size) - 1;
 
   if(debug)
   {
       fprintf(cacheLog, "**************************************************************************************************************************\n");
-      fprintf(cacheLog, "Input params: cache_size = %d\nblock_size = %d\nn_blocks = %d\nassociativity = %d\nn_sets = %d\nblock_offset = %d\nmask_size = %d\nmask = %d\n", cache_usize, cache_block_size, n_blocks, cache_assoc, n_sets, block_offset, mask_size, mask);
+      fprintf(cacheLog, "Input params: cache_size = %d\nblock_size = %d\nn_blocks = %d\nassociativity = %d\nn_sets = %d\nblock_offset = %d\nmask_size = %d\nmask = %llu\n", cache_usize, cache_block_size, n_blocks, cache_assoc, n_sets, block_offset, mask_size, mask);
       fprintf(cacheLog, "**************************************************************************************************************************\n");
   }
 
+  mesi_cache = (Pcache)calloc(num_core, sizeof(cache));
+  mesi_cache_stat = (Pcache_stat)calloc(num_core, sizeof(cache_stat));
+  if(mesi_cache == NULL || mesi_cache_stat == NULL)
+     {printf("error : Memory allocation failed for %d cores\n", num_core); exit(-1);}
+
+  uniform = TRUE;
+  max_sets = 0;
+  min_offset = -1;
   for(i = 0; i < num_core; i++)
   {
+     core_geometry(i, &usize, &assoc, &block_size);
+     n_sets = usize/block_size/assoc;
+     block_offset = LOG2(block_size);
+     mask_size = LOG2(n_sets) + block_offset;
      mesi_cache[i].id = i;
-     mesi_cache[i].size = cache_usize;
-     mesi_cache[i].associativity = cache_assoc;
+     mesi_cache[i].size = usize;
+     mesi_cache[i].associativity = assoc;
+     mesi_cache[i].block_size = block_size;
      mesi_cache[i].n_sets = n_sets;
-     mesi_cache[i].index_mask = mask;
+     mesi_cache[i].index_mask = (1ULL<<mask_size) - 1;
      mesi_cache[i].index_mask_offset = block_offset;
+     mesi_cache[i].tag_shift = mask_size;
+     mesi_cache[i].set_bits = LOG2(n_sets);
+
+     if(usize != mesi_cache[0].size || assoc != mesi_cache[0].associativity || block_size != mesi_cache[0].block_size)
+        uniform = FALSE;
+     if(n_sets > max_sets) max_sets = n_sets;
+     if(min_offset < 0 || block_offset < min_offset) min_offset = block_offset;
   }
 
   //Printing Initialized output
@@ -95,165 +481,651 @@ void init_cache()
      for(i = 0; i < num_core; i++)
      {
         printf("-----------------Core %d------------------------------\n", i);
-        printf("number of sets = %d\nmask_size = %d\nMask = %d\nMask_offset = %d\n", mesi_cache[i].n_sets, mask_size, mesi_cache[i].index_mask, mesi_cache[i].index_mask_offset);
+        printf("number of sets = %d\nmask_size = %d\nMask = %llu\nMask_offset = %d\n", mesi_cache[i].n_sets, mesi_cache[i].tag_shift, mesi_cache[i].index_mask, mesi_cache[i].index_mask_offset);
         printf("-----------------------------------------------\n");
      }
   }
 
-  //Dynamically allocating memory for LRU head, LRU tail and contents arrays
+  //Dynamically allocating the flat tag store, sized once for the whole run
   for(i = 0; i < num_core; i++)
   {
-     mesi_cache[i].LRU_head = (Pcache_line*)malloc(sizeof(Pcache_line)*mesi_cache[i].n_sets);
-     mesi_cache[i].LRU_tail = (Pcache_line*)malloc(sizeof(Pcache_line)*mesi_cache[i].n_sets);
+     n_lines = mesi_cache[i].n_sets * mesi_cache[i].associativity;
+     mesi_cache[i].tags = (unsigned long long*)malloc(sizeof(unsigned long long)*n_lines);
+     mesi_cache[i].states = (unsigned char*)malloc(sizeof(unsigned char)*n_lines);
+     mesi_cache[i].ranks = (unsigned char*)malloc(sizeof(unsigned char)*n_lines);
      mesi_cache[i].set_contents = (int*)malloc(sizeof(int)*mesi_cache[i].n_sets);
   }
 
   //Checking if memory is allocated properly or not
   for(i = 0; i < num_core; i++)
   {
-     if(mesi_cache[i].LRU_head == NULL || mesi_cache[i].LRU_tail == NULL || mesi_cache[i].set_contents == NULL)
-        {printf("error : Memory allocation failed for mesi_cache[%d] LRU_head, LRU_tail\n", i); exit(-1);}
+     if(mesi_cache[i].tags == NULL || mesi_cache[i].states == NULL || mesi_cache[i].ranks == NULL || mesi_cache[i].set_contents == NULL)
+        {printf("error : Memory allocation failed for mesi_cache[%d] tag store\n", i); exit(-1);}
 
   }
 
-  //Initializing set_contents
+  //Initializing set_contents. Unused ways hold a tag no address maps to
+  //and a rank above every real one, so lookups can scan all ways of a set.
   for(i = 0; i < num_core; i++)
   {
      for(j = 0; j < mesi_cache[i].n_sets; j++)
-     {
         mesi_cache[i].set_contents[j] = 0;
-        mesi_cache[i].LRU_head[j] = (Pcache_line)NULL;
-        mesi_cache[i].LRU_tail[j] = (Pcache_line)NULL;
+     n_lines = mesi_cache[i].n_sets * mesi_cache[i].associativity;
+     for(j = 0; j < n_lines; j++)
+     {
+        mesi_cache[i].tags[j] = EMPTY_TAG;
+        mesi_cache[i].ranks[j] = EMPTY_RANK;
      }
+     repl_init(&mesi_cache[i], repl_policy);
+  }
+
+  //Mixed geometries take the generic kernel, which reads each core's own
+  access_kernel = access_generic;
+  batch_kernel = batch_generic;
+  if(uniform)
+     access_kernel = select_kernel(mesi_cache[0].associativity, mesi_cache[0].block_size, &batch_kernel);
+
+  //The snoop filter tracks granules of the smallest block size, a line of
+  //a core with larger blocks being listed under every granule it covers.
+  //It never tracks more granules than the caches can hold, so twice their
+  //total keeps it at most half full.
+  granules = 0;
+  lines = (int*)malloc(sizeof(int)*num_core);
+  if(lines == NULL) {printf("error : Memory allocation failed for %d cores\n", num_core); exit(-1);}
+  max_lines = 0;
+  for(i = 0; i < num_core; i++)
+  {
+     mesi_cache[i].granule_shift = mesi_cache[i].index_mask_offset - min_offset;
+     lines[i] = mesi_cache[i].n_sets * mesi_cache[i].associativity;
+     granules += (long)lines[i] << mesi_cache[i].granule_shift;
+     if(lines[i] > max_lines) max_lines = lines[i];
+  }
+  if(snoop_filter)
+     init_directory(2L * granules);
+
+  //Past this point every core has the same block size. The models of the
+  //other modules live in this thread's statics, which save_context()
+  //copies into the structures allocated here.
+  block_size = mesi_cache[0].block_size;
+  block_offset = mesi_cache[0].index_mask_offset;
+  hier_model = NULL;
+  timing_model = NULL;
+  classify_model = NULL;
+  hot_model = NULL;
+  prefetch_model = NULL;
+  wbuf_model = NULL;
+  if(l2_usize || llc_usize)
+  {
+     hier_init(l2_usize, l2_assoc, llc_usize, llc_assoc, llc_policy, block_size, num_core);
+     hierarchy = TRUE;
+     hier_model = (hier_context*)model(sizeof(hier_context));
+  }
+  if(timing)
+  {
+     timing_init(lat, N_LATENCIES, bus_width, bus_arb, block_size, num_core);
+     timing_model = (timing_context*)model(sizeof(timing_context));
+  }
+  if(classify)
+  {
+     classify_init(num_core, lines, block_size);
+     classify_model = (classify_context*)model(sizeof(classify_context));
+  }
+  if(hot)
+  {
+     hot_init(hot_k, num_core, block_offset);
+     hot_model = (hot_context*)model(sizeof(hot_context));
+  }
+  if(prefetcher)
+  {
+     prefetch_init(prefetch_kind, prefetch_degree, num_core, max_lines, block_offset, timing);
+     prefetch_model = (prefetch_context*)model(sizeof(prefetch_context));
+  }
+  if(wbuf)
+  {
+     wbuf_init(wbuf_entries, num_core, block_size, timing);
+     wbuf_model = (wbuf_context*)model(sizeof(wbuf_context));
+  }
+  free(lines);
+}
+/************************************************************/
+
+/************************************************************/
+/* allocates an empty snoop filter with room for at least entries blocks */
+void init_directory(long entries)
+{
+  long n_slots;
+
+  sharer_words = (num_core + 63) / 64;
+  for(n_slots = 1; n_slots < entries; n_slots <<= 1);
+  dir_blocks = (unsigned long long*)malloc(sizeof(unsigned long long)*n_slots);
+  dir_count = (int*)calloc(n_slots, sizeof(int));
+  dir_bits = (unsigned long long*)calloc((size_t)n_slots * sharer_words, sizeof(unsigned long long));
+  sharers = (unsigned long long*)malloc(sizeof(unsigned long long)*sharer_words);
+  if(dir_blocks == NULL || dir_count == NULL || dir_bits == NULL || sharers == NULL)
+     {printf("error : Memory allocation failed for the snoop filter\n"); exit(-1);}
+  dir_mask = n_slots - 1;
+}
+/************************************************************/
+
+/************************************************************/
+/* Set operations shared by every kernel. assoc is a compile time constant
+   in the specialized kernels, so these loops unroll completely. */
+
+//Tri-state search of set index for tag
+static inline __attribute__((always_inline))
+int search_ways(Pcache c, unsigned index, unsigned long long tag, int *hitAt, const int assoc)
+{
+   int line, end;
+
+   line = index * assoc;
+   for(end = line + assoc; line < end; line++)
+   {
+      if(c->tags[line] == tag)
+      {
+         *hitAt = line;
+         if(c->states[line] == INVALID_STATE)
+            return TAG_HIT_INVALID;
+         else
+            return TAG_HIT_VALID;
+      }
+   }
+   *hitAt = -1;
+   return TAG_MISS;
+}
+
+//Makes line the most recently used line of its set
+static inline __attribute__((always_inline))
+void touch_ways(Pcache c, unsigned index, int line, const int assoc)
+{
+  unsigned char *ranks = &c->ranks[index * assoc];
+  int way, rank;
+
+  rank = c->ranks[line];
+  for (way = 0; way < assoc; way++)
+    if (ranks[way] < rank)
+      ranks[way]++;
+  c->ranks[line] = 0;
+}
+
+//Returns the least recently used line of a full set
+static inline __attribute__((always_inline))
+int lru_victim_ways(Pcache c, unsigned index, const int assoc)
+{
+  int base, way;
+
+  base = index * assoc;
+  for (way = 0; way < assoc; way++)
+    if (c->ranks[base + way] == assoc - 1)
+      return base + way;
+
+  printf("error_info : no LRU line in a full set\n");
+  exit(-1);
+}
+
+//True LRU is inlined into the kernels, the other policies of repl.c are
+//called through their table
+static inline __attribute__((always_inline))
+void hit_ways(Pcache c, unsigned index, int line, const int assoc)
+{
+  if (c->policy == REPL_LRU)
+    touch_ways(c, index, line, assoc);
+  else
+    replacements[c->policy].hit(c, index, line);
+}
+
+static inline __attribute__((always_inline))
+int victim_ways(Pcache c, unsigned index, const int assoc)
+{
+  if (c->policy == REPL_LRU)
+    return lru_victim_ways(c, index, assoc);
+  return replacements[c->policy].victim(c, index);
+}
+
+//Puts tag into line, or into the next unused way of the set if line is -1
+static inline __attribute__((always_inline))
+int fill_ways(Pcache c, unsigned index, unsigned long long tag, int line, const int assoc)
+{
+  if (line < 0) {
+    line = index * assoc + c->set_contents[index];
+    c->ranks[line] = c->set_contents[index]++;
   }
+  c->tags[line] = tag;
+  if (c->policy == REPL_LRU)
+    touch_ways(c, index, line, assoc);
+  else
+    replacements[c->policy].fill(c, index, line);
+  return line;
+}
+/************************************************************/
+
+/************************************************************/
+/* The snoop filter lists line (tag, index) of core pid under every granule
+   it covers; with a single block size that is just its block */
+static inline void dir_add_line(Pcache c, unsigned long long tag, unsigned index, unsigned pid)
+{
+  unsigned long long granule = BLOCK_OF(c, tag, index) << c->granule_shift;
+  int n;
+
+  for(n = 1 << c->granule_shift; n; n--)
+     dir_add(granule++, pid);
+}
+
+static inline void dir_remove_line(Pcache c, unsigned long long tag, unsigned index, unsigned pid)
+{
+  unsigned long long granule = BLOCK_OF(c, tag, index) << c->granule_shift;
+  int n;
+
+  for(n = 1 << c->granule_shift; n; n--)
+     dir_remove(granule++, pid);
+}
+/************************************************************/
+
+/************************************************************/
+/* Brings block (tag, index) into the cache of core pid: broadcasts the
+   request, evicts a victim if the set is full and fills the line from
+   whichever level supplies the block. line is the invalidated line to
+   reuse, -1 if the tag missed altogether. Demand misses and prefetches
+   both go through here. */
+static inline __attribute__((always_inline))
+int fill_block(Pcache c, unsigned pid, unsigned index, unsigned long long tag, unsigned request_type, int line, const int assoc)
+{
+int victim = -1, snoop, source;
+unsigned char state, spill_state = INVALID_STATE;
+unsigned long long spill = 0;
+
+//Buffered stores to the block reach memory before it is read
+if(wbuf) wbuf_snoop(BLOCK_OF(c, tag, index), pid, TRUE);
+
+//Initiate broadcast and set appropriate state
+state = INVALID_STATE;
+snoop = BroadcastnSetState(request_type, tag, index, pid, &state, FALSE);
+
+if(line < 0)
+{
+   if(c->set_contents[index] == assoc) //While evicting
+   {
+      mesi_cache_stat[pid].replacements++;
+      victim = victim_ways(c, index, assoc);
+
+      //While evicting, copy back to memory if the block is dirty
+      if(proto->dirty[c->states[victim]])
+      {
+         if(debug) fprintf(cacheLog, "Evicting %s block\n", c->states[victim] == MODIFIED_STATE ? "MODIFIED" : "OWNED");
+         mesi_cache_stat[pid].copies_back += c->block_size/WORD_SIZE;
+         if(timing && !l2_usize) timing_write_back(); //A private L2 takes it off the bus
+         if(hot) hot_event(BLOCK_OF(c, c->tags[victim], index), pid, HOT_WRITE_BACK);
+      }
+
+      if(snoop_filter && c->states[victim] != INVALID_STATE)
+         dir_remove_line(c, c->tags[victim], index, pid);
+
+      if(hierarchy)
+      {
+         spill = BLOCK_OF(c, c->tags[victim], index);
+         spill_state = c->states[victim];
+      }
+   }
+
+   //Put the cache line into the cache, replacing the victim if the set is full
+   PROF_START(t_fill);
+   line = fill_ways(c, index, tag, victim, assoc);
+   PROF_END(PROF_LRU, t_fill);
+}
+else //TAG_HIT_INVALID reuses the invalidated line
+{
+   PROF_START(t_reuse);
+   fill_ways(c, index, tag, line, assoc);
+   PROF_END(PROF_LRU, t_reuse);
+}
+
+//A block no other core supplied comes from the levels below
+source = FILL_PEER;
+if(snoop != SNOOP_SUPPLIED)
+   source = hierarchy ? hier_fetch(BLOCK_OF(c, tag, index), pid, &state) : FILL_DRAM;
+if(timing) timing_fill(source);
+
+c->states[line] = state;
+if(snoop_filter) dir_add_line(c, tag, index, pid);
+
+//The victim moves to the levels below once the new block is in place,
+//so an exclusive LLC never takes in the block being filled
+if(spill_state != INVALID_STATE)
+   hier_evict(spill, pid, proto->dirty[spill_state]);
+return line;
+}
+/************************************************************/
+
+/************************************************************/
+/* A store that goes on to memory, written through or around the cache */
+static void write_word(unsigned long long block, unsigned word, unsigned pid)
+{
+mesi_cache_stat[pid].write_throughs++;
+if(wbuf)
+   wbuf_store(block, word, pid);
+else
+{
+   mesi_cache_stat[pid].write_words++;
+   mesi_cache_stat[pid].write_transactions++;
+   if(timing) timing_write_through(1, TRUE);
+}
+}
+
+/* A write miss without write allocate: the other copies are invalidated,
+   copying back if dirty, and the word is written around the cache */
+static void write_around(Pcache c, unsigned pid, unsigned index, unsigned long long tag, unsigned word)
+{
+if(debug) fprintf(cacheLog, "(broadcast) Is a WRITE_MISS, written around\n");
+if(wbuf) wbuf_snoop(BLOCK_OF(c, tag, index), pid, FALSE);
+BroadcastnSearch(tag, index, REMOTE_WRITE_MISS, pid);
+write_word(BLOCK_OF(c, tag, index), word, pid);
 }
 /************************************************************/
 
 /************************************************************/
-void perform_access(unsigned addr, unsigned access_type, unsigned pid)
+/* Handles accesses to the mesi caches. The body is inlined into one kernel
+   per common geometry, where assoc and block_bits are compile time
+   constants, and into a generic kernel that reads them from the cache. */
+//Runs a reference of a valid pid whose request has been counted by
+//isReadorWrite()
+static inline __attribute__((always_inline))
+void access_request(unsigned long long addr, unsigned request_type, unsigned pid, const int assoc, const int block_bits)
 {
-/* handle accesses to the mesi caches */
-int mask_size;
-unsigned int index, tag, request_type, n_sets, search_result;
-Pcache_line c_line, hitAt;
+int line;
+unsigned int index, word, search_result;
+unsigned long long tag;
+Pcache c;
 
-mask_size = LOG2(mesi_cache[pid].n_sets) + mesi_cache[pid].index_mask_offset;
-index = (addr & mesi_cache[pid].index_mask) >> mesi_cache[pid].index_mask_offset;
-tag = addr >> mask_size;
-request_type = isReadorWrite(access_type, pid);
-n_sets = mesi_cache[pid].n_sets;
+c = &mesi_cache[pid];
+index = ADDR_INDEX(c, addr, block_bits);
+tag = ADDR_TAG(c, addr);
+word = (addr >> WORD_SIZE_OFFSET) & ((1 << (block_bits - WORD_SIZE_OFFSET)) - 1);
 
 ref_count++;
+if(timing) timing_begin(pid);
 
-if(debug) fprintf(cacheLog, "Ref(%d): core = %d, addr = %x, index = %d, tag = %x -- ", ref_count, pid, addr, index, tag);
+if(debug) fprintf(cacheLog, "Ref(%lld): core = %d, addr = %llx, index = %d, tag = %llx -- ", ref_count, pid, addr, index, tag);
 
 mesi_cache_stat[pid].accesses++;
 
-if(mesi_cache[pid].LRU_head[index] == NULL) //Miss with no Replacement
+PROF_START(t_lookup);
+search_result = search_ways(c, index, tag, &line, assoc);
+PROF_END(PROF_LOOKUP, t_lookup);
+
+if(search_result == TAG_MISS || search_result == TAG_HIT_INVALID)
+{
+   mesi_cache_stat[pid].misses++;
+   if(request_type == WRITE_REQUEST && !cache_writealloc)
+   {
+      write_around(c, pid, index, tag, word);
+      line = -1;
+   }
+   else
+      line = fill_block(c, pid, index, tag, request_type, search_result == TAG_MISS ? -1 : line, assoc);
+}
+else if(search_result == TAG_HIT_VALID) //Hit
+{
+   //Replacement update on a hit
+   PROF_START(t_hit);
+   hit_ways(c, index, line, assoc);
+   PROF_END(PROF_LRU, t_hit);
+
+   if(request_type == READ_REQUEST)
+   {
+      if(debug) fprintf(cacheLog, "Is a READ_HIT\n");
+      //mesiST_Local(&c->states[line], READ_HIT); //Stay in the same state. *REDUNDANT*
+   }
+   else if(request_type == WRITE_REQUEST)
+   {
+      if(proto->table[WRITE_HIT][c->states[line]].flags & T_BROADCAST)
+         BroadcastnSetState(request_type, tag, index, pid, &c->states[line], TRUE); //Broadcast to invalidate other cache blocks
+      else
+      {
+         //A silent upgrade still makes the other cores' L2 copies stale
+         if(hierarchy && c->states[line] == EXCLUSIVE_STATE)
+            hier_snoop(BLOCK_OF(c, tag, index), pid, REMOTE_WRITE_MISS);
+         mesiST_Local(&c->states[line], WRITE_HIT); //No broadcast on a WRITE HIT on an exclusive or modified block
+         if(debug) fprintf(cacheLog, "Is a WRITE_HIT\n");
+      }
+   }
+   else { printf("error_info : unknown request_type\n"); exit(-1);}
+}
+else { printf("error_info : search function returning an unknow state\n"); exit(-1);}
+
+//A write-through store leaves its line clean, in the state a read miss
+//from memory would give it, and sends the word on to memory
+if(request_type == WRITE_REQUEST && !cache_writeback && line >= 0)
+{
+   if(c->states[line] == MODIFIED_STATE)
+      c->states[line] = proto->table[READ_MISS_FROM_MEMORY][INVALID_STATE].next;
+   write_word(BLOCK_OF(c, tag, index), word, pid);
+}
+
+//Classified once the broadcasts are done, so a store is newer than the
+//invalidations it caused
+if(classify == CLASSIFY_SEEN)
+   classify_seen(BLOCK_OF(c, tag, index), pid);
+else if(classify)
+{
+   if(search_result == TAG_HIT_VALID)
+      classify_hit(BLOCK_OF(c, tag, index), pid);
+   else
+      classify_miss(BLOCK_OF(c, tag, index), word, pid);
+   if(request_type == WRITE_REQUEST)
+      classify_write(BLOCK_OF(c, tag, index), word);
+}
+
+//The prefetcher trains once the reference is done, so the prefetches it
+//issues never overtake it
+if(prefetcher)
+{
+   if(prefetch_access(BLOCK_OF(c, tag, index), pid, line, search_result == TAG_HIT_VALID) && classify)
+      classify_seen(BLOCK_OF(c, tag, index), pid); //A prefetch took the first reference's miss
+}
+
+if(timing) timing_end(pid);
+if(debug) PrintLiveStats();
+if(debug) PrintCache(max_sets);
+}
+
+static inline __attribute__((always_inline))
+void access_body(unsigned long long addr, unsigned access_type, unsigned pid, const int assoc, const int block_bits)
+{
+if(pid >= (unsigned)num_core) {printf("error : Reference from core %d, but only %d cores are simulated\n", pid, num_core); exit(-1);}
+access_request(addr, isReadorWrite(access_type, pid), pid, assoc, block_bits);
+}
+/************************************************************/
+
+/************************************************************/
+/* Batched replay. Each chunk of records is classified first: the loads
+   and stores are checked and counted by isReadorWrite(), the other records
+   being skipped as the trace readers skip them. The chunk is then run in
+   order while the set metadata of the record BATCH_LOOKAHEAD places ahead
+   is prefetched, so that its cache misses overlap the work on the ones
+   before it. The counters come out as with one perform_access() per
+   reference. */
+#define BATCH_CHUNK 1024
+#define BATCH_LOOKAHEAD 8
+
+//An assoc of 0 takes each core's own geometry, for the generic kernel
+#define BATCH_ASSOC(c) (assoc ? assoc : (c)->associativity)
+#define BATCH_BITS(c) (assoc ? block_bits : (c)->index_mask_offset)
+
+static inline __attribute__((always_inline))
+void prefetch_set(unsigned long long addr, unsigned pid, const int assoc, const int block_bits)
+{
+   Pcache c = &mesi_cache[pid];
+   unsigned index = (addr & c->index_mask) >> BATCH_BITS(c);
+   int first = index * BATCH_ASSOC(c);
+
+   __builtin_prefetch(&c->tags[first]);
+   if(BATCH_ASSOC(c) > 8) __builtin_prefetch(&c->tags[first + 8]);
+   __builtin_prefetch(&c->states[first]);
+   __builtin_prefetch(&c->set_contents[index]);
+   if(c->policy == REPL_LRU)
+      __builtin_prefetch(&c->ranks[first]);
+   else
+      __builtin_prefetch(&c->repl[index]);
+}
+
+static inline __attribute__((always_inline))
+void batch_body(trace_record *rec, int n, const int assoc, const int block_bits)
+{
+   int i, j, end;
+   trace_record *r;
+   Pcache c;
+
+   for(i = 0; i < n; i = end)
+   {
+      end = n - i > BATCH_CHUNK ? i + BATCH_CHUNK : n;
+      for(j = i; j < end; j++)
+      {
+         r = &rec[j];
+         if(!IS_ACCESS(r))
+            continue;
+         if(r->pid >= num_core) {printf("error : Reference from core %d, but only %d cores are simulated\n", r->pid, num_core); exit(-1);}
+         isReadorWrite(r->access_type, r->pid);
+      }
+
+      //Records ahead may lie in the next chunk, not checked yet
+      for(j = i; j < end; j++)
+      {
+         if(j + BATCH_LOOKAHEAD < n && rec[j + BATCH_LOOKAHEAD].pid < num_core)
+            prefetch_set(rec[j + BATCH_LOOKAHEAD].addr, rec[j + BATCH_LOOKAHEAD].pid, assoc, block_bits);
+         r = &rec[j];
+         if(!IS_ACCESS(r))
+            continue;
+         c = &mesi_cache[r->pid];
+         access_request(r->addr, r->access_type == DATA_STORE_REFERENCE ? WRITE_REQUEST : READ_REQUEST, r->pid, BATCH_ASSOC(c), BATCH_BITS(c));
+      }
+   }
+}
+/************************************************************/
+
+/************************************************************/
+#define KERNEL(assoc, block) \
+static void access_##assoc##_##block(unsigned long long addr, unsigned access_type, unsigned pid) \
+{ access_body(addr, access_type, pid, assoc, LOG2_##block); } \
+static void batch_##assoc##_##block(trace_record *rec, int n) \
+{ batch_body(rec, n, assoc, LOG2_##block); }
+#define LOG2_16 4
+#define LOG2_32 5
+#define LOG2_64 6
+
+KERNEL(1, 16) KERNEL(1, 32) KERNEL(1, 64)
+KERNEL(2, 16) KERNEL(2, 32) KERNEL(2, 64)
+KERNEL(4, 16) KERNEL(4, 32) KERNEL(4, 64)
+KERNEL(8, 16) KERNEL(8, 32) KERNEL(8, 64)
+KERNEL(16, 16) KERNEL(16, 32) KERNEL(16, 64)
+
+static void access_generic(unsigned long long addr, unsigned access_type, unsigned pid)
+{
+  if(pid >= (unsigned)num_core) {printf("error : Reference from core %d, but only %d cores are simulated\n", pid, num_core); exit(-1);}
+  access_body(addr, access_type, pid, mesi_cache[pid].associativity, mesi_cache[pid].index_mask_offset);
+}
+
+static void batch_generic(trace_record *rec, int n)
+{
+  batch_body(rec, n, 0, 0);
+}
+
+/* kernels by [LOG2(associativity)][LOG2(block size) - 4] */
+static const access_fn kernels[5][3] = {
+  { access_1_16, access_1_32, access_1_64 },
+  { access_2_16, access_2_32, access_2_64 },
+  { access_4_16, access_4_32, access_4_64 },
+  { access_8_16, access_8_32, access_8_64 },
+  { access_16_16, access_16_32, access_16_64 },
+};
+
+static const batch_fn batch_kernels[5][3] = {
+  { batch_1_16, batch_1_32, batch_1_64 },
+  { batch_2_16, batch_2_32, batch_2_64 },
+  { batch_4_16, batch_4_32, batch_4_64 },
+  { batch_8_16, batch_8_32, batch_8_64 },
+  { batch_16_16, batch_16_32, batch_16_64 },
+};
+
+/* picks the kernels specialized for a geometry, or the generic ones */
+access_fn select_kernel(int assoc, int block_size, batch_fn *batch)
+{
+  int a, b;
+
+  for(a = 0; a < 5 && (1 << a) != assoc; a++);
+  for(b = 0; b < 3 && (16 << b) != block_size; b++);
+  if(a == 5 || b == 3)
+  {
+     *batch = batch_generic;
+     return access_generic;
+  }
+  *batch = batch_kernels[a][b];
+  return kernels[a][b];
+}
+
+void perform_access(unsigned long long addr, unsigned access_type, unsigned pid)
 {
-   mesi_cache_stat[pid].misses++;
-
-   //Create the cache line
-   c_line = allocateCL(tag);
+  access_kernel(addr, access_type, pid);
+}
 
-   //Initiate broadcast and set appropriate state
-   BroadcastnSetState(request_type, tag, index, pid, c_line, FALSE);
+/* runs the loads and stores of n trace records in order, see batch_body() */
+void perform_batch(trace_record *rec, int n)
+{
+  int i;
 
-   //Put the cache line into the cache
-   insert(&mesi_cache[pid].LRU_head[index], &mesi_cache[pid].LRU_tail[index], c_line);
-   mesi_cache[pid].set_contents[index]++;
+  if(debug) //The live log follows every reference's counters
+  {
+     for(i = 0; i < n; i++)
+        if(IS_ACCESS(&rec[i]))
+           perform_access(rec[i].addr, rec[i].access_type, rec[i].pid);
+     return;
+  }
+  batch_kernel(rec, n);
 }
-else
-{
-   search_result = search(mesi_cache[pid].LRU_head[index], tag, &hitAt); 
 
-   if(search_result == TAG_MISS || search_result == TAG_HIT_INVALID)
-   {
-      mesi_cache_stat[pid].misses++;
+/* Fetches block into the cache of pid unless it already holds a valid
+   copy. The prefetch is a coherent read miss in every respect, except
+   that its fetch and broadcast are counted as prefetch traffic and, with
+   -timing, the core does not wait for it. */
+void prefetch_block(unsigned long long block, unsigned pid)
+{
+  Pcache c = &mesi_cache[pid];
+  unsigned index = BLOCK_INDEX(c, block);
+  unsigned long long tag = BLOCK_TAG(c, block);
+  int line;
 
-      if(search_result == TAG_HIT_INVALID)
-      {
-         if(hitAt == NULL) { printf("error_info : hitAt is NULL\n"); exit(-1); }
-         c_line = hitAt;
-      }
-      else //Creating the cache_line to be inserted
-         c_line = allocateCL(tag);
- 
-      //Initiate broadcast and set appropriate state
-      BroadcastnSetState(request_type, tag, index, pid, c_line, FALSE);
+  if(search(c, index, tag, &line) == TAG_HIT_VALID)
+     return;
+  if(debug) fprintf(cacheLog, "(prefetch %llx) ", block);
+  mesi_cache_stat[pid].prefetches++;
+  if(timing) timing_prefetch_begin();
+  prefetch_issue = TRUE;
+  line = fill_block(c, pid, index, tag, READ_REQUEST, line, c->associativity);
+  prefetch_issue = FALSE;
+  prefetch_filled(pid, line, timing ? timing_prefetch_end() : 0);
+}
+/************************************************************/
 
-      if(search_result == TAG_MISS)
-      {
-         if(mesi_cache[pid].set_contents[index] < mesi_cache[pid].associativity)
-         {
-            //Inserting the cache line
-            insert(&mesi_cache[pid].LRU_head[index], &mesi_cache[pid].LRU_tail[index], c_line);
-            mesi_cache[pid].set_contents[index]++;
-         }
-         else //While evicting
-         {
-            mesi_cache_stat[pid].replacements++;
-
-            //While evicting, copy back to memory if the block is in MODIFIED state
-            if(mesi_cache[pid].LRU_tail[index]->state == MODIFIED_STATE)
-            {
-               if(debug) fprintf(cacheLog, "Evicting MODIFIED block\n");
-               mesi_cache_stat[pid].copies_back += cache_block_size/WORD_SIZE;
-            }
-            else
-            {
-               //if(debug) fprintf(cacheLog, "Evicting INVALID or EXCLUSIVE or SHARED block\n");
-            }
-
-            delete(&mesi_cache[pid].LRU_head[index], &mesi_cache[pid].LRU_tail[index], mesi_cache[pid].LRU_tail[index]);
-            insert(&mesi_cache[pid].LRU_head[index], &mesi_cache[pid].LRU_tail[index], c_line);
-         }
-      }
-      else if(search_result == TAG_HIT_INVALID)
-      {
-         delete(&mesi_cache[pid].LRU_head[index], &mesi_cache[pid].LRU_tail[index], c_line);
-         insert(&mesi_cache[pid].LRU_head[index], &mesi_cache[pid].LRU_tail[index], c_line);
-         
-      }
-      else { printf("error_info : search function returning an unknown state\n"); exit(-1);}
-   }
-   else if(search_result == TAG_HIT_VALID) //Hit
+/************************************************************/
+/* Sampled simulation, see sample.c. Every phase keeps the tag stores and
+   coherence state of all levels exact. Fast-forwarding suspends the models
+   that only observe the references: timing, hot blocks and, but for the
+   record of which cores referenced each block, miss classification. The
+   warm-up phase runs them all but hot blocks, which only count measured
+   references. */
+void set_phase(int next)
+{
+   if(next == phase)
+      return;
+   if(phase == PHASE_MEASURE)
    {
-      //LRU Implementation on a hit
-      delete(&mesi_cache[pid].LRU_head[index], &mesi_cache[pid].LRU_tail[index], hitAt);
-      insert(&mesi_cache[pid].LRU_head[index], &mesi_cache[pid].LRU_tail[index], hitAt);
-
-      if(request_type == READ_REQUEST)
-      {
-         if(debug) fprintf(cacheLog, "Is a READ_HIT\n");
-         //mesiST_Local(hitAt, READ_HIT); //Stay in the same state. *REDUNDANT*
-      }
-      else if(request_type == WRITE_REQUEST)
-      {
-         switch(hitAt->state)
-         {
-            case EXCLUSIVE_STATE:
-               mesiST_Local(hitAt, WRITE_HIT); //Main optimization of MESI. No broadcast on a WRITE HIT on an exclusive block
-               if(debug) fprintf(cacheLog, "Is a WRITE_HIT\n");
-               break;
-            case SHARED_STATE:
-               BroadcastnSetState(request_type, tag, index, pid, hitAt, TRUE); //Broadcast to invalidate other cache blocks
-               break;
-            case MODIFIED_STATE:
-               //mesiST_Local(hitAt, WRITE_HIT); //Stay in modified state. *REDUNDANT*
-               if(debug) fprintf(cacheLog, "Is a WRITE_HIT\n");
-               break;
-            default:
-               {printf("error_info : Wrong state during a write hit\n"); exit(-1);}
-               break;
-         }
-      }
-      else { printf("error_info : unknown request_type\n"); exit(-1);}
+      enabled_timing = timing;
+      enabled_classify = classify;
+      enabled_hot = hot;
    }
-   else { printf("error_info : search function returning an unknow state\n"); exit(-1);}
-}
-if(debug) PrintLiveStats();
-if(debug) PrintCache(n_sets);
+   phase = next;
+   timing = enabled_timing && phase != PHASE_FAST_FORWARD;
+   classify = enabled_classify && phase == PHASE_FAST_FORWARD ? CLASSIFY_SEEN : enabled_classify;
+   hot = enabled_hot && phase == PHASE_MEASURE;
+   if(enabled_timing) timing_pause(!timing);
 }
 /************************************************************/
 
@@ -262,75 +1134,75 @@ void flush()
 {
    if(debug) fprintf(cacheLog, "Initiating flush\n");
   /* flush the mesi caches */
-  int i, pid;
-  Pcache_line c_line, n_line;
+  int i, way, pid;
+  Pcache c;
 
   for(pid = 0; pid < num_core; pid++)
   {
-     for(i = 0; i < mesi_cache[pid].n_sets; i++)
+     c = &mesi_cache[pid];
+     for(i = 0; i < c->n_sets; i++)
      {
-        c_line = mesi_cache[pid].LRU_head[i];
-        if(c_line != NULL)
+        for(way = 0; way < c->set_contents[i]; way++)
         {
-           if(c_line->state == MODIFIED_STATE)
-              mesi_cache_stat[pid].copies_back += cache_block_size/WORD_SIZE;
-           while(c_line->LRU_next != NULL)
+           if(proto->dirty[c->states[i * c->associativity + way]])
            {
-              n_line = c_line->LRU_next;
-              if(n_line->state == MODIFIED_STATE)
-                 mesi_cache_stat[pid].copies_back += cache_block_size/WORD_SIZE;
-              c_line = n_line;
+              mesi_cache_stat[pid].copies_back += c->block_size/WORD_SIZE;
+              if(hierarchy) hier_flush_line(BLOCK_OF(c, c->tags[i * c->associativity + way], i), pid);
            }
         }
      }
   }
+  if(hierarchy) hier_flush();
+  if(wbuf) wbuf_flush();
   if(debug) PrintLiveStats();
-  if(debug) fclose(cacheLog);
+  if(debug) fflush(cacheLog);
 }
 /************************************************************/
 
 /************************************************************/
-void delete(Pcache_line *head, Pcache_line *tail, Pcache_line item)
+void touch(Pcache c, unsigned index, int line)
 {
-  if (item->LRU_prev) {
-    item->LRU_prev->LRU_next = item->LRU_next;
-  } else {
-    /* item at head */
-    *head = item->LRU_next;
-  }
-
-  if (item->LRU_next) {
-    item->LRU_next->LRU_prev = item->LRU_prev;
-  } else {
-    /* item at tail */
-    *tail = item->LRU_prev;
-  }
+  touch_ways(c, index, line, c->associativity);
 }
-/************************************************************/
 
-/************************************************************/
-/* inserts at the head of the list */
-void insert(Pcache_line *head, Pcache_line *tail, Pcache_line item)
+int lru_victim(Pcache c, unsigned index)
 {
-  item->LRU_next = *head;
-  item->LRU_prev = (Pcache_line)NULL;
+  return lru_victim_ways(c, index, c->associativity);
+}
 
-  if (item->LRU_next)
-    item->LRU_next->LRU_prev = item;
-  else
-    *tail = item;
+//Inserts tag into its set, replacing a victim if the set is full
+int insert(Pcache c, unsigned index, unsigned long long tag)
+{
+  int victim = -1;
 
-  *head = item;
+  if (c->set_contents[index] == c->associativity)
+    victim = victim_ways(c, index, c->associativity);
+  return fill_ways(c, index, tag, victim, c->associativity);
 }
 /************************************************************/
 
 /************************************************************/
 void dump_settings()
 {
+  int i;
+
   printf("Cache Settings:\n");
   printf("\tSize: \t%d\n", cache_usize);
   printf("\tAssociativity: \t%d\n", cache_assoc);
   printf("\tBlock size: \t%d\n", cache_block_size);
+  for(i = 0; i < n_groups; i++)
+     printf("\tCores %d-%d: \t%d bytes, %d-way, %d byte blocks\n", groups[i].first, groups[i].last,
+            groups[i].usize, groups[i].assoc, groups[i].block_size);
+  if(snoop_filter) printf("\tSnoop filter: \ton\n");
+  if(protocol_id != DEFAULT_PROTOCOL) printf("\tProtocol: \t%s\n", proto->name);
+  if(prefetcher) printf("\tPrefetcher: \t%s, degree %d\n", prefetch_name(prefetch_kind), prefetch_degree);
+  if(!cache_writeback || !cache_writealloc)
+     printf("\tWrite policy: \t%s, %s\n", cache_writeback ? "write-back" : "write-through",
+            cache_writealloc ? "write-allocate" : "no-write-allocate");
+  if(wbuf) printf("\tWrite buffer: \t%d entries per core\n", wbuf_entries);
+  if(repl_policy != DEFAULT_REPL) printf("\tReplacement: \t%s\n", replacements[repl_policy].name);
+  if(l2_usize) printf("\tL2: \t\t%d bytes, %d-way, per core\n", l2_usize, l2_assoc);
+  if(llc_usize) printf("\tLLC: \t\t%d bytes, %d-way, %s\n", llc_usize, llc_assoc, llc_policy_name());
 }
 /************************************************************/
 
@@ -338,32 +1210,38 @@ void dump_settings()
 void print_stats()
 {
   int i;
-  int demand_fetches = 0;
-  int copies_back = 0;
-  int broadcasts = 0;
-  int read_requests = 0;
-  int write_requests = 0;
-  int total_accesses = 0;
-  int total_misses = 0;
-  int total_replacements = 0;
-  int fetches_from_memory = 0;
+  long long demand_fetches = 0;
+  long long prefetch_fetches = 0;
+  long long copies_back = 0;
+  long long broadcasts = 0;
+  long long read_requests = 0;
+  long long write_requests = 0;
+  long long total_accesses = 0;
+  long long total_misses = 0;
+  long long total_replacements = 0;
+  long long fetches_from_memory = 0;
+  long long snoops = 0;
+  long long snoops_wasted = 0;
+  long long write_throughs = 0;
+  long long write_words = 0;
 
   printf("*** CACHE STATISTICS ***\n");
 
   for (i = 0; i < num_core; i++) {
     printf("  CORE %d\n", i);
-    printf("  accesses:  %d\n", mesi_cache_stat[i].accesses);
-    printf("  misses:    %d\n", mesi_cache_stat[i].misses);
+    printf("  accesses:  %lld\n", mesi_cache_stat[i].accesses);
+    printf("  misses:    %lld\n", mesi_cache_stat[i].misses);
     printf("  miss rate: %f (%f)\n", 
 	   (float)mesi_cache_stat[i].misses / (float)mesi_cache_stat[i].accesses,
 	   1.0 - (float)mesi_cache_stat[i].misses / (float)mesi_cache_stat[i].accesses);
-    printf("  replace:   %d\n", mesi_cache_stat[i].replacements);
+    printf("  replace:   %lld\n", mesi_cache_stat[i].replacements);
   }
 
   printf("\n");
   printf("  TRAFFIC\n");
   for (i = 0; i < num_core; i++) {
     demand_fetches += mesi_cache_stat[i].demand_fetches;
+    prefetch_fetches += mesi_cache_stat[i].prefetch_fetches;
     fetches_from_memory += mesi_cache_stat[i].fetches_from_memory;
     copies_back += mesi_cache_stat[i].copies_back;
     broadcasts += mesi_cache_stat[i].broadcasts;
@@ -372,34 +1250,600 @@ void print_stats()
     total_accesses += mesi_cache_stat[i].accesses;
     total_misses += mesi_cache_stat[i].misses;
     total_replacements += mesi_cache_stat[i].replacements;
+    snoops += mesi_cache_stat[i].snoops;
+    snoops_wasted += mesi_cache_stat[i].snoops_wasted;
+    write_throughs += mesi_cache_stat[i].write_throughs;
+    write_words += mesi_cache_stat[i].write_words;
   }
   if(debug && MORE_STATS) //Aggregate stats
   {
-     printf("  accesses =            %d\n", total_accesses);
-     printf("  misses =              %d\n", total_misses);
-     printf("  replacements =        %d\n", total_replacements);
-     printf("  read requests:        %d\n", read_requests);
-     printf("  write requests:       %d\n", write_requests);
+     printf("  accesses =            %lld\n", total_accesses);
+     printf("  misses =              %lld\n", total_misses);
+     printf("  replacements =        %lld\n", total_replacements);
+     printf("  read requests:        %lld\n", read_requests);
+     printf("  write requests:       %lld\n", write_requests);
   }
-  printf("  demand fetch (words): %d\n", demand_fetches);
-  if(MORE_STATS)  printf("  fetches from memory(words): %d\n", fetches_from_memory);
+  printf("  demand fetch (words): %lld\n", demand_fetches);
+  if(prefetcher) printf("  prefetch fetch (words): %lld\n", prefetch_fetches);
+  if(MORE_STATS || protocol_id != DEFAULT_PROTOCOL)  printf("  fetches from memory(words): %lld\n", fetches_from_memory);
   /* number of broadcasts */
-  printf("  broadcasts:           %d\n", broadcasts);
-  printf("  copies back (words):  %d\n", copies_back);
+  printf("  broadcasts:           %lld\n", broadcasts);
+  printf("  copies back (words):  %lld\n", copies_back);
+  if(!cache_writeback || !cache_writealloc)
+  {
+     printf("  stores to memory:     %lld\n", write_throughs);
+     printf("  write through (words): %lld\n", write_words);
+     printf("  memory writes (words): %lld\n", copies_back + write_words);
+  }
+  if(snoop_filter || MORE_STATS)
+  {
+     printf("  snoop probes:         %lld\n", snoops);
+     printf("  wasted snoops:        %lld%s\n", snoops_wasted, snoop_filter ? " (filtered)" : "");
+  }
+  if(hierarchy)
+     print_hierarchy_stats(demand_fetches + prefetch_fetches);
+  if(classify)
+     print_classify_stats(mesi_cache[0].index_mask_offset);
+  if(hot)
+     print_hot_stats();
+  if(prefetcher)
+     print_prefetch_stats();
+  if(wbuf)
+     print_wbuf_stats();
+  if(timing)
+     print_timing_stats();
+}
+
+/* splits the traffic of the private caches into on-chip and DRAM */
+void print_hierarchy_stats(long long fetches)
+{
+  int i;
+  cache_stat t;
+
+  memset(&t, 0, sizeof(t));
+  for (i = 0; i < num_core; i++) {
+    t.l2_accesses += mesi_cache_stat[i].l2_accesses;
+    t.l2_misses += mesi_cache_stat[i].l2_misses;
+    t.llc_accesses += mesi_cache_stat[i].llc_accesses;
+    t.llc_misses += mesi_cache_stat[i].llc_misses;
+    t.dram_fetches += mesi_cache_stat[i].dram_fetches;
+    t.dram_copies_back += mesi_cache_stat[i].dram_copies_back;
+    t.back_invalidations += mesi_cache_stat[i].back_invalidations;
+  }
+
+  printf("\n");
+  printf("  HIERARCHY\n");
+  if(l2_usize)
+  {
+     printf("  L2 accesses:          %lld\n", t.l2_accesses);
+     printf("  L2 misses:            %lld\n", t.l2_misses);
+  }
+  if(llc_usize)
+  {
+     printf("  LLC accesses:         %lld\n", t.llc_accesses);
+     printf("  LLC misses:           %lld\n", t.llc_misses);
+     if(llc_policy == LLC_INCLUSIVE)
+        printf("  back invalidations:   %lld\n", t.back_invalidations);
+  }
+  printf("  on-chip fetch (words): %lld\n", fetches - t.dram_fetches);
+  printf("  DRAM fetch (words):   %lld\n", t.dram_fetches);
+  printf("  DRAM copies back (words): %lld\n", t.dram_copies_back);
+}
+/************************************************************/
+
+/************************************************************/
+/* one line per configuration summary used by sweeps */
+void print_stats_header()
+{
+  printf("%8s %5s %5s %6s %12s %12s %9s %12s %14s %12s %14s\n",
+         "size", "assoc", "block", "repl", "accesses", "misses", "miss_rate",
+         "replace", "demand_fetch", "broadcasts", "copies_back");
+}
+
+void print_stats_row()
+{
+  int i;
+  long long accesses = 0, misses = 0, total_replacements = 0;
+  long long demand_fetches = 0, broadcasts = 0, copies_back = 0;
+
+  for (i = 0; i < num_core; i++) {
+    accesses += mesi_cache_stat[i].accesses;
+    misses += mesi_cache_stat[i].misses;
+    total_replacements += mesi_cache_stat[i].replacements;
+    demand_fetches += mesi_cache_stat[i].demand_fetches;
+    broadcasts += mesi_cache_stat[i].broadcasts;
+    copies_back += mesi_cache_stat[i].copies_back;
+  }
+  printf("%8d %5d %5d %6s %12lld %12lld %9f %12lld %14lld %12lld %14lld\n",
+         cache_usize, cache_assoc, cache_block_size, replacements[repl_policy].name, accesses, misses,
+         accesses ? (float)misses / (float)accesses : 0.0, total_replacements,
+         demand_fetches, broadcasts, copies_back);
+}
+/************************************************************/
+
+/************************************************************/
+void save_context(Pcache_context ctx)
+{
+  ctx->cache_usize = cache_usize;
+  ctx->cache_block_size = cache_block_size;
+  ctx->words_per_block = words_per_block;
+  ctx->cache_assoc = cache_assoc;
+  ctx->cache_writeback = cache_writeback;
+  ctx->cache_writealloc = cache_writealloc;
+  ctx->num_core = num_core;
+  ctx->mesi_cache = mesi_cache;
+  ctx->mesi_cache_stat = mesi_cache_stat;
+  ctx->ref_count = ref_count;
+  ctx->snoop_filter = snoop_filter;
+  ctx->protocol = protocol_id;
+  ctx->repl_policy = repl_policy;
+  ctx->dir_blocks = dir_blocks;
+  ctx->dir_count = dir_count;
+  ctx->dir_bits = dir_bits;
+  ctx->dir_mask = dir_mask;
+  ctx->sharer_words = sharer_words;
+  ctx->sharers = sharers;
+  ctx->uniform = uniform;
+  ctx->max_sets = max_sets;
+  ctx->access_kernel = access_kernel;
+  ctx->batch_kernel = batch_kernel;
+#ifdef CACHE_DEBUG
+  ctx->debug = debug;
+#endif
+  ctx->l2_usize = l2_usize;
+  ctx->l2_assoc = l2_assoc;
+  ctx->llc_usize = llc_usize;
+  ctx->llc_assoc = llc_assoc;
+  ctx->llc_policy = llc_policy;
+  ctx->hierarchy = hierarchy;
+  memcpy(ctx->lat, lat, sizeof(lat));
+  ctx->bus_width = bus_width;
+  ctx->bus_arb = bus_arb;
+  ctx->timing = timing;
+  ctx->classify = classify;
+  ctx->hot_k = hot_k;
+  ctx->hot = hot;
+  ctx->phase = phase;
+  ctx->enabled_timing = enabled_timing;
+  ctx->enabled_classify = enabled_classify;
+  ctx->enabled_hot = enabled_hot;
+  ctx->prefetch_kind = prefetch_kind;
+  ctx->prefetch_degree = prefetch_degree;
+  ctx->prefetcher = prefetcher;
+  ctx->wbuf_entries = wbuf_entries;
+  ctx->wbuf = wbuf;
+  ctx->hier_model = hier_model;
+  ctx->timing_model = timing_model;
+  ctx->classify_model = classify_model;
+  ctx->hot_model = hot_model;
+  ctx->prefetch_model = prefetch_model;
+  ctx->wbuf_model = wbuf_model;
+  if(hier_model) hier_save(hier_model);
+  if(timing_model) timing_save(timing_model);
+  if(classify_model) classify_save(classify_model);
+  if(hot_model) hot_save(hot_model);
+  if(prefetch_model) prefetch_save(prefetch_model);
+  if(wbuf_model) wbuf_save(wbuf_model);
+}
+
+void load_context(Pcache_context ctx)
+{
+  cache_usize = ctx->cache_usize;
+  cache_block_size = ctx->cache_block_size;
+  words_per_block = ctx->words_per_block;
+  cache_assoc = ctx->cache_assoc;
+  cache_writeback = ctx->cache_writeback;
+  cache_writealloc = ctx->cache_writealloc;
+  num_core = ctx->num_core;
+  mesi_cache = ctx->mesi_cache;
+  mesi_cache_stat = ctx->mesi_cache_stat;
+  ref_count = ctx->ref_count;
+  snoop_filter = ctx->snoop_filter;
+  protocol_id = ctx->protocol;
+  proto = &protocols[protocol_id];
+  repl_policy = ctx->repl_policy;
+  dir_blocks = ctx->dir_blocks;
+  dir_count = ctx->dir_count;
+  dir_bits = ctx->dir_bits;
+  dir_mask = ctx->dir_mask;
+  sharer_words = ctx->sharer_words;
+  sharers = ctx->sharers;
+  uniform = ctx->uniform;
+  max_sets = ctx->max_sets;
+  access_kernel = ctx->access_kernel;
+  batch_kernel = ctx->batch_kernel;
+#ifdef CACHE_DEBUG
+  debug = ctx->debug;
+#endif
+  l2_usize = ctx->l2_usize;
+  l2_assoc = ctx->l2_assoc;
+  llc_usize = ctx->llc_usize;
+  llc_assoc = ctx->llc_assoc;
+  llc_policy = ctx->llc_policy;
+  hierarchy = ctx->hierarchy;
+  memcpy(lat, ctx->lat, sizeof(lat));
+  bus_width = ctx->bus_width;
+  bus_arb = ctx->bus_arb;
+  timing = ctx->timing;
+  classify = ctx->classify;
+  hot_k = ctx->hot_k;
+  hot = ctx->hot;
+  phase = ctx->phase;
+  enabled_timing = ctx->enabled_timing;
+  enabled_classify = ctx->enabled_classify;
+  enabled_hot = ctx->enabled_hot;
+  prefetch_kind = ctx->prefetch_kind;
+  prefetch_degree = ctx->prefetch_degree;
+  prefetcher = ctx->prefetcher;
+  prefetch_issue = FALSE;
+  wbuf_entries = ctx->wbuf_entries;
+  wbuf = ctx->wbuf;
+  hier_model = ctx->hier_model;
+  timing_model = ctx->timing_model;
+  classify_model = ctx->classify_model;
+  hot_model = ctx->hot_model;
+  prefetch_model = ctx->prefetch_model;
+  wbuf_model = ctx->wbuf_model;
+  if(hier_model) hier_load(hier_model);
+  if(timing_model) timing_load(timing_model);
+  if(classify_model) classify_load(classify_model);
+  if(hot_model) hot_load(hot_model);
+  if(prefetch_model) prefetch_load(prefetch_model);
+  if(wbuf_model) wbuf_load(wbuf_model);
+}
+/************************************************************/
+
+/************************************************************/
+/* Puts every parameter of this thread back to its default and forgets the
+   current model, whose structures stay with whoever saved its context, so
+   that the next init_cache() builds a fresh one. */
+void reset_cache_params()
+{
+  cache_usize = DEFAULT_CACHE_SIZE;
+  cache_block_size = DEFAULT_CACHE_BLOCK_SIZE;
+  words_per_block = DEFAULT_CACHE_BLOCK_SIZE / WORD_SIZE;
+  cache_assoc = DEFAULT_CACHE_ASSOC;
+  cache_writeback = DEFAULT_CACHE_WRITEBACK;
+  cache_writealloc = DEFAULT_CACHE_WRITEALLOC;
+  num_core = DEFAULT_NUM_CORE;
+  mesi_cache = NULL;
+  mesi_cache_stat = NULL;
+  ref_count = 0;
+  snoop_filter = DEFAULT_SNOOP_FILTER;
+  dir_blocks = NULL;
+  dir_count = NULL;
+  dir_bits = NULL;
+  dir_mask = 0;
+  sharer_words = 0;
+  sharers = NULL;
+  n_groups = 0;
+  protocol_id = DEFAULT_PROTOCOL;
+  proto = &protocols[DEFAULT_PROTOCOL];
+  repl_policy = DEFAULT_REPL;
+#ifdef CACHE_DEBUG
+  debug = DEFAULT_DEBUG;
+#endif
+  l2_usize = llc_usize = 0;
+  l2_assoc = DEFAULT_L2_ASSOC;
+  llc_assoc = DEFAULT_LLC_ASSOC;
+  llc_policy = DEFAULT_LLC_POLICY;
+  lat[0] = DEFAULT_LAT_HIT;
+  lat[1] = DEFAULT_LAT_C2C;
+  lat[2] = DEFAULT_LAT_MEM;
+  lat[3] = DEFAULT_LAT_L2;
+  lat[4] = DEFAULT_LAT_LLC;
+  bus_width = DEFAULT_BUS_WIDTH;
+  bus_arb = DEFAULT_BUS_ARB;
+  hot_k = 0;
+  phase = PHASE_MEASURE;
+  enabled_timing = enabled_classify = enabled_hot = FALSE;
+  prefetch_kind = PREFETCH_NONE;
+  prefetch_degree = DEFAULT_PREFETCH_DEGREE;
+  wbuf_entries = 0;
+  hierarchy = timing = classify = hot = FALSE;
+  prefetcher = prefetch_issue = wbuf = FALSE;
+  hier_model = NULL;
+  timing_model = NULL;
+  classify_model = NULL;
+  hot_model = NULL;
+  prefetch_model = NULL;
+  wbuf_model = NULL;
+}
+
+/* frees the tag stores, statistics, snoop filter and models of a context
+   built by init_cache() */
+void free_context(Pcache_context ctx)
+{
+  int i;
+
+  for(i = 0; i < ctx->num_core; i++)
+  {
+     free(ctx->mesi_cache[i].tags);
+     free(ctx->mesi_cache[i].states);
+     free(ctx->mesi_cache[i].ranks);
+     free(ctx->mesi_cache[i].set_contents);
+     free(ctx->mesi_cache[i].repl);
+     free(ctx->mesi_cache[i].seeds);
+  }
+  free(ctx->mesi_cache);
+  free(ctx->mesi_cache_stat);
+  free(ctx->dir_blocks);
+  free(ctx->dir_count);
+  free(ctx->dir_bits);
+  free(ctx->sharers);
+  if(ctx->hier_model) {hier_free(ctx->hier_model); free(ctx->hier_model);}
+  if(ctx->timing_model) {timing_free(ctx->timing_model); free(ctx->timing_model);}
+  if(ctx->classify_model) {classify_free(ctx->classify_model); free(ctx->classify_model);}
+  if(ctx->hot_model) {hot_free(ctx->hot_model); free(ctx->hot_model);}
+  if(ctx->prefetch_model) {prefetch_free(ctx->prefetch_model); free(ctx->prefetch_model);}
+  if(ctx->wbuf_model) {wbuf_free(ctx->wbuf_model); free(ctx->wbuf_model);}
+}
+/************************************************************/
+
+/************************************************************/
+/* Saves the complete state of the current model. The snoop filter is not
+   written, read_checkpoint() rebuilds it from the tag store. */
+void write_checkpoint(char *file, long long num_inst, long long trace_offset)
+{
+  FILE *f;
+  ckpt_header h;
+  int i, geometry[3], n_lines, ok = 1;
+
+  f = fopen(file, "wb");
+  if(f == NULL) {printf("error : Unable to create checkpoint %s\n", file); exit(-1);}
+
+  memset(&h, 0, sizeof(h));
+  strcpy(h.magic, CKPT_MAGIC);
+  h.version = CKPT_VERSION;
+  h.num_core = num_core;
+  h.cache_usize = cache_usize;
+  h.cache_block_size = cache_block_size;
+  h.cache_assoc = cache_assoc;
+  h.snoop_filter = snoop_filter;
+  h.protocol = protocol_id;
+  h.repl = repl_policy;
+  h.writeback = cache_writeback;
+  h.writealloc = cache_writealloc;
+  h.ref_count = ref_count;
+  h.num_inst = num_inst;
+  h.trace_offset = trace_offset;
+  ok &= fwrite(&h, sizeof(h), 1, f) == 1;
+  for(i = 0; i < num_core; i++)
+  {
+     geometry[0] = mesi_cache[i].size;
+     geometry[1] = mesi_cache[i].associativity;
+     geometry[2] = mesi_cache[i].block_size;
+     ok &= fwrite(geometry, sizeof(int), 3, f) == 3;
+  }
+
+  for(i = 0; i < num_core; i++)
+  {
+     n_lines = mesi_cache[i].n_sets * mesi_cache[i].associativity;
+     ok &= fwrite(mesi_cache[i].set_contents, sizeof(int), mesi_cache[i].n_sets, f) == (size_t)mesi_cache[i].n_sets;
+     ok &= fwrite(mesi_cache[i].tags, sizeof(unsigned long long), n_lines, f) == (size_t)n_lines;
+     ok &= fwrite(mesi_cache[i].states, sizeof(unsigned char), n_lines, f) == (size_t)n_lines;
+     ok &= fwrite(mesi_cache[i].ranks, sizeof(unsigned char), n_lines, f) == (size_t)n_lines;
+     ok &= fwrite(mesi_cache[i].repl, sizeof(unsigned long long), mesi_cache[i].n_sets, f) == (size_t)mesi_cache[i].n_sets;
+     ok &= fwrite(mesi_cache[i].seeds, sizeof(unsigned), mesi_cache[i].n_sets, f) == (size_t)mesi_cache[i].n_sets;
+  }
+  ok &= fwrite(mesi_cache_stat, sizeof(cache_stat), num_core, f) == (size_t)num_core;
+
+  if(fclose(f) != 0 || !ok) {printf("error : Write to checkpoint %s failed\n", file); exit(-1);}
+}
+
+/* Restores a checkpoint into the current model, which must have been
+   initialized with the same configuration */
+void read_checkpoint(char *file, long long *num_inst, long long *trace_offset)
+{
+  FILE *f;
+  ckpt_header h;
+  int i, line, n_lines, geometry[3], ok = 1;
+
+  f = fopen(file, "rb");
+  if(f == NULL) {printf("error : Unable to open checkpoint %s\n", file); exit(-1);}
+
+  if(fread(&h, sizeof(h), 1, f) != 1 || strcmp(h.magic, CKPT_MAGIC) || h.version != CKPT_VERSION ||
+     h.protocol < 0 || h.protocol >= N_PROTOCOLS || h.repl < 0 || h.repl >= N_REPL_POLICIES)
+     {printf("error : %s is not a checkpoint of this simulator version\n", file); exit(-1);}
+  if(h.num_core != num_core || h.cache_usize != cache_usize || h.cache_block_size != cache_block_size ||
+     h.cache_assoc != cache_assoc || h.snoop_filter != snoop_filter || h.protocol != protocol_id ||
+     h.repl != repl_policy || h.writeback != cache_writeback || h.writealloc != cache_writealloc)
+  {
+     printf("error : Checkpoint %s was taken with -n %d -us %d -bs %d -a %d -proto %s -repl %s%s%s%s\n", file,
+            h.num_core, h.cache_usize, h.cache_block_size, h.cache_assoc,
+            protocols[h.protocol].name, replacements[h.repl].name, h.snoop_filter ? " -sf" : "",
+            h.writeback ? "" : " -wt", h.writealloc ? "" : " -nw");
+     exit(-1);
+  }
+  for(i = 0; i < num_core; i++)
+  {
+     if(fread(geometry, sizeof(int), 3, f) != 3)
+        {printf("error : Checkpoint %s is truncated\n", file); exit(-1);}
+     if(geometry[0] != mesi_cache[i].size || geometry[1] != mesi_cache[i].associativity || geometry[2] != mesi_cache[i].block_size)
+        {printf("error : Checkpoint %s was taken with core %d of %d bytes, %d-way, %d byte blocks\n", file, i, geometry[0], geometry[1], geometry[2]); exit(-1);}
+  }
+
+  for(i = 0; i < num_core; i++)
+  {
+     n_lines = mesi_cache[i].n_sets * mesi_cache[i].associativity;
+     ok &= fread(mesi_cache[i].set_contents, sizeof(int), mesi_cache[i].n_sets, f) == (size_t)mesi_cache[i].n_sets;
+     ok &= fread(mesi_cache[i].tags, sizeof(unsigned long long), n_lines, f) == (size_t)n_lines;
+     ok &= fread(mesi_cache[i].states, sizeof(unsigned char), n_lines, f) == (size_t)n_lines;
+     ok &= fread(mesi_cache[i].ranks, sizeof(unsigned char), n_lines, f) == (size_t)n_lines;
+     ok &= fread(mesi_cache[i].repl, sizeof(unsigned long long), mesi_cache[i].n_sets, f) == (size_t)mesi_cache[i].n_sets;
+     ok &= fread(mesi_cache[i].seeds, sizeof(unsigned), mesi_cache[i].n_sets, f) == (size_t)mesi_cache[i].n_sets;
+  }
+  ok &= fread(mesi_cache_stat, sizeof(cache_stat), num_core, f) == (size_t)num_core;
+  fclose(f);
+  if(!ok) {printf("error : Checkpoint %s is truncated\n", file); exit(-1);}
+
+  if(snoop_filter)
+  {
+     for(i = 0; i < num_core; i++)
+     {
+        n_lines = mesi_cache[i].n_sets * mesi_cache[i].associativity;
+        for(line = 0; line < n_lines; line++)
+           if(line % mesi_cache[i].associativity < mesi_cache[i].set_contents[line / mesi_cache[i].associativity] &&
+              mesi_cache[i].states[line] != INVALID_STATE)
+              dir_add_line(&mesi_cache[i], mesi_cache[i].tags[line], line / mesi_cache[i].associativity, i);
+     }
+  }
+
+  ref_count = h.ref_count;
+  *num_inst = h.num_inst;
+  *trace_offset = h.trace_offset;
 }
 /************************************************************/
 
+/************************************************************/
+/* Sets of every core share one geometry, and coherence only ever touches
+   the same set across cores, so disjoint set ranges can be simulated
+   independently. A shard context shares the tag store of the current
+   context but has its own statistics and snoop filter. */
+void split_context(Pcache_context shard, int shard_sets)
+{
+  cache_context base;
+
+  save_context(&base);
+  mesi_cache_stat = (Pcache_stat)calloc(num_core, sizeof(cache_stat));
+  if(mesi_cache_stat == NULL) {printf("error : Memory allocation failed for shard statistics\n"); exit(-1);}
+  ref_count = 0;
+  if(snoop_filter)
+     init_directory(2L * num_core * cache_assoc * shard_sets);
+  save_context(shard);
+  load_context(&base);
+}
+
+/* adds the statistics of a finished shard into the current context */
+void merge_context(Pcache_context shard)
+{
+  add_stats(mesi_cache_stat, shard->mesi_cache_stat);
+  ref_count += shard->ref_count;
+}
+
+/* adds every core's counters in src into dst */
+void add_stats(Pcache_stat dst, Pcache_stat src)
+{
+  int i;
+
+  for(i = 0; i < num_core; i++)
+  {
+     dst[i].accesses += src[i].accesses;
+     dst[i].misses += src[i].misses;
+     dst[i].replacements += src[i].replacements;
+     dst[i].demand_fetches += src[i].demand_fetches;
+     dst[i].copies_back += src[i].copies_back;
+     dst[i].fetches_from_memory += src[i].fetches_from_memory;
+     dst[i].broadcasts += src[i].broadcasts;
+     dst[i].read_requests += src[i].read_requests;
+     dst[i].write_requests += src[i].write_requests;
+     dst[i].snoops += src[i].snoops;
+     dst[i].snoops_wasted += src[i].snoops_wasted;
+     dst[i].l2_accesses += src[i].l2_accesses;
+     dst[i].l2_misses += src[i].l2_misses;
+     dst[i].llc_accesses += src[i].llc_accesses;
+     dst[i].llc_misses += src[i].llc_misses;
+     dst[i].dram_fetches += src[i].dram_fetches;
+     dst[i].dram_copies_back += src[i].dram_copies_back;
+     dst[i].back_invalidations += src[i].back_invalidations;
+     dst[i].cycles += src[i].cycles;
+     dst[i].bus_wait += src[i].bus_wait;
+     dst[i].compulsory_misses += src[i].compulsory_misses;
+     dst[i].capacity_misses += src[i].capacity_misses;
+     dst[i].conflict_misses += src[i].conflict_misses;
+     dst[i].true_sharing_misses += src[i].true_sharing_misses;
+     dst[i].false_sharing_misses += src[i].false_sharing_misses;
+     dst[i].prefetches += src[i].prefetches;
+     dst[i].prefetch_hits += src[i].prefetch_hits;
+     dst[i].prefetch_late += src[i].prefetch_late;
+     dst[i].prefetch_invalidated += src[i].prefetch_invalidated;
+     dst[i].prefetch_distance += src[i].prefetch_distance;
+     dst[i].prefetch_fetches += src[i].prefetch_fetches;
+     dst[i].prefetch_broadcasts += src[i].prefetch_broadcasts;
+     dst[i].write_throughs += src[i].write_throughs;
+     dst[i].write_words += src[i].write_words;
+     dst[i].write_transactions += src[i].write_transactions;
+  }
+}
+
+/* directs the counters of later accesses to stats, returns the old array */
+Pcache_stat swap_stats(Pcache_stat stats)
+{
+  Pcache_stat old = mesi_cache_stat;
+
+  mesi_cache_stat = stats;
+  return old;
+}
+
+unsigned set_index(unsigned long long addr)
+{
+  return ADDR_INDEX(&mesi_cache[0], addr, mesi_cache[0].index_mask_offset);
+}
+
+int num_sets()
+{
+  return mesi_cache[0].n_sets;
+}
+
+int num_cores()
+{
+  return num_core;
+}
+
+void current_config(int *usize, int *assoc, int *block_size, char **protocol, char **repl)
+{
+  *usize = cache_usize;
+  *assoc = cache_assoc;
+  *block_size = cache_block_size;
+  *protocol = proto->name;
+  *repl = replacements[repl_policy].name;
+}
+
+Pcache_stat core_stats(int pid)
+{
+  return &mesi_cache_stat[pid];
+}
+
+/* TRUE if a private cache holds a valid copy of block. The hierarchy
+   needs a single block size, so block means the same to every core. */
+int held_in_l1(unsigned long long block)
+{
+  int i, line;
+  Pcache c;
+
+  if(snoop_filter)
+     return dir_find(block) >= 0;
+  for(i = 0; i < num_core; i++)
+  {
+     c = &mesi_cache[i];
+     if(search(c, BLOCK_INDEX(c, block), BLOCK_TAG(c, block), &line) == TAG_HIT_VALID)
+        return TRUE;
+  }
+  return FALSE;
+}
 
-//Allocate cache line
-Pcache_line allocateCL(unsigned tag)
+/* Invalidates every private copy of block for an inclusive LLC eviction.
+   Sets *dirty if one of them was dirty, returns how many were dropped. */
+int back_invalidate(unsigned long long block, int *dirty)
 {
-   Pcache_line c_line;
-   c_line = (Pcache_line)malloc(sizeof(cache_line));
-   c_line->tag = tag;
-   c_line->LRU_next = (Pcache_line)NULL;
-   c_line->LRU_prev = (Pcache_line)NULL;
-   return c_line;
+  int i, line, n = 0;
+  Pcache c;
+
+  for(i = 0; i < num_core; i++)
+  {
+     c = &mesi_cache[i];
+     if(search(c, BLOCK_INDEX(c, block), BLOCK_TAG(c, block), &line) != TAG_HIT_VALID)
+        continue;
+     if(proto->dirty[c->states[line]])
+        *dirty = TRUE;
+     c->states[line] = INVALID_STATE;
+     if(snoop_filter) dir_remove(block, i);
+     if(prefetcher) prefetch_invalidate(i, line);
+     n++;
+  }
+  return n;
 }
+/************************************************************/
 
 
 unsigned isReadorWrite(unsigned access_type, unsigned pid)
@@ -415,240 +1859,213 @@ switch(access_type)
       mesi_cache_stat[pid].write_requests++;
       return WRITE_REQUEST;
       break;
-   defualt:
+   default:
       printf("error : Unrecognized access_type\n");
       exit(-1);
      break;
 }
 }
 
-int BroadcastnSearch(unsigned tag, unsigned index, unsigned broadcast_type, unsigned broadcasting_core)
+//Applies a snooped broadcast to line (tag, index) of core i. Returns
+//TRUE if the core held it valid, setting *supplied if it answers the miss.
+static inline __attribute__((always_inline))
+int snoop_line(unsigned i, unsigned index, unsigned long long tag, unsigned broadcast_type, int *supplied)
+{
+   Pcache c = &mesi_cache[i];
+   int hitAt;
+
+   if(search(c, index, tag, &hitAt) != TAG_HIT_VALID)
+      return FALSE;
+   //if(debug) printf("debug_info : state at remote hit = %d\n", c->states[hitAt]);
+   *supplied |= proto->supplies[c->states[hitAt]];
+   if(mesiST_Remote(&c->states[hitAt], broadcast_type, i))
+   {
+      if(hierarchy) hier_write_back(BLOCK_OF(c, tag, index), i);
+      if(hot) hot_event(BLOCK_OF(c, tag, index), i, HOT_WRITE_BACK);
+   }
+   if(c->states[hitAt] == INVALID_STATE)
+   {
+      if(classify) classify_invalidate(BLOCK_OF(c, tag, index), i);
+      if(prefetcher) prefetch_invalidate(i, hitAt);
+      if(hot) hot_event(BLOCK_OF(c, tag, index), i, HOT_INVALIDATION);
+      if(snoop_filter) dir_remove_line(c, tag, index, i);
+   }
+   return TRUE;
+}
+
+//Snoops core i for block (tag, index) of core r. A core of another
+//geometry finds the block under its own index and tag: one line if its
+//blocks are at least as large, else each of its lines inside the block.
+//Returns TRUE if the core held any of them.
+static inline __attribute__((always_inline))
+int snoop_core(unsigned i, Pcache r, unsigned long long tag, unsigned index, unsigned broadcast_type, int *supplied)
+{
+   Pcache c = &mesi_cache[i];
+   unsigned long long addr, end;
+   int held = FALSE;
+
+   if(uniform)
+      return snoop_line(i, index, tag, broadcast_type, supplied);
+   addr = BLOCK_OF(r, tag, index) << r->index_mask_offset;
+   end = addr + r->block_size;
+   for(addr &= ~((unsigned long long)c->block_size - 1); addr < end; addr += c->block_size)
+      held |= snoop_line(i, ADDR_INDEX(c, addr, c->index_mask_offset), ADDR_TAG(c, addr), broadcast_type, supplied);
+   return held;
+}
+
+int BroadcastnSearch(unsigned long long tag, unsigned index, unsigned broadcast_type, unsigned broadcasting_core)
 {
    //There are 3 types of broadcast_types supported
    //1. Read miss -> REMOTE_READ_MISS
    //2. Write miss -> REMOTE_WRITE_MISS
    //3. Write hit -> REMOTE_WRITE_HIT
    //Note REMOTE_READ_HIT won't be broadcast across the bus
+   //Returns SNOOP_NONE if no other core holds the block, SNOOP_SUPPLIED if
+   //a holder in a supplying state or, below an exclusive LLC, a peer L2
+   //answers, else SNOOP_SHARED
 
-   int i, found = FALSE;
-   Pcache_line c_line, hitAt;
+   int i, w, n, slot, found = 0, supplied = FALSE;
+   unsigned long long bits, granule;
+   Pcache r = &mesi_cache[broadcasting_core];
+   PROF_START(t_broadcast);
    mesi_cache_stat[broadcasting_core].broadcasts++;
-   for(i = 0; i < num_core; i++)
+   if(prefetch_issue) mesi_cache_stat[broadcasting_core].prefetch_broadcasts++;
+   if(timing) timing_broadcast();
+   if(snoop_filter) //Probe only the cores the snoop filter lists as sharers
    {
-      if(i != broadcasting_core)
+      //Gather the sharers of every granule of the block into a copy, since
+      //invalidations below may move or free the slots
+      granule = BLOCK_OF(r, tag, index) << r->granule_shift;
+      slot = dir_find(granule);
+      if(slot >= 0)
+         memcpy(sharers, &dir_bits[(size_t)slot * sharer_words], sizeof(unsigned long long)*sharer_words);
+      else
+         memset(sharers, 0, sizeof(unsigned long long)*sharer_words);
+      for(n = (1 << r->granule_shift) - 1; n; n--)
+      {
+         slot = dir_find(++granule);
+         if(slot >= 0)
+            for(w = 0; w < sharer_words; w++)
+               sharers[w] |= dir_bits[(size_t)slot * sharer_words + w];
+      }
+      sharers[broadcasting_core / 64] &= ~(1ULL << (broadcasting_core % 64));
+      for(w = 0; w < sharer_words; w++)
       {
-         c_line = mesi_cache[i].LRU_head[index];
-         if(c_line != NULL)
+         for(bits = sharers[w]; bits; bits &= bits - 1)
          {
-            if(search(c_line, tag, &hitAt) == TAG_HIT_VALID)
-            {
-               //if(debug) printf("debug_info : state at remote hit = %d\n", c_line->state);
-               if(!found) found = TRUE;
-               mesiST_Remote(hitAt, broadcast_type, i);
-            }
+            i = w * 64 + __builtin_ctzll(bits);
+            if(!snoop_core(i, r, tag, index, broadcast_type, &supplied))
+               {printf("error_info : snoop filter lists core %d for a block it does not hold\n", i); exit(-1);}
+            found++;
          }
       }
    }
-   if(found) return TRUE;
-   else return FALSE;
+   else
+   {
+      for(i = 0; i < num_core; i++)
+         if(i != (int)broadcasting_core)
+            found += snoop_core(i, r, tag, index, broadcast_type, &supplied);
+   }
+   mesi_cache_stat[broadcasting_core].snoops += snoop_filter ? found : num_core - 1;
+   mesi_cache_stat[broadcasting_core].snoops_wasted += num_core - 1 - found;
+   if(hierarchy && hier_snoop(BLOCK_OF(r, tag, index), broadcasting_core, broadcast_type))
+      supplied = TRUE; //A peer L2 answers on chip, see hier_snoop()
+   if(hot && supplied && broadcast_type != REMOTE_WRITE_HIT)
+      hot_event(BLOCK_OF(r, tag, index), broadcasting_core, HOT_TRANSFER);
+   PROF_END(PROF_BROADCAST, t_broadcast);
+   if(supplied) return SNOOP_SUPPLIED;
+   return found ? SNOOP_SHARED : SNOOP_NONE;
 }
 
 
-void mesiST_Remote(Pcache_line c_line, unsigned whatHappened, unsigned pid)
+//State transitions of the selected protocol, one table lookup per event.
+//mesiST_Remote applies snooped events, charging any copy back to the
+//snooping core and returning TRUE for it, mesiST_Local applies the
+//requesting core's own events.
+int mesiST_Remote(unsigned char *state, unsigned whatHappened, unsigned pid)
 {
-   unsigned current_state;
-   if(c_line == NULL)
+   const transition *t;
+   PROF_START(t_transition);
+   if(state == NULL)
    {
       printf("error_info : mesiStateTransition funciton called on an unallocated cache line\n");
       exit(-1);
    }
-   else
+   if(whatHappened < REMOTE_READ_MISS || whatHappened > REMOTE_WRITE_MISS)
    {
-      current_state  = c_line->state;
-      switch(whatHappened)
-      {
-         case REMOTE_READ_MISS:
-            current_state  = c_line->state;
-            switch(current_state)
-            {
-               case INVALID_STATE:
-                  printf("error_info : REMOTE_READ_MISS on a invalid state\n");
-                  exit(-1);
-                  break;
-               case EXCLUSIVE_STATE:
-               case SHARED_STATE:
-                  c_line->state = SHARED_STATE;
-                  break;
-               case MODIFIED_STATE:
-                  mesi_cache_stat[pid].copies_back += cache_block_size/WORD_SIZE;
-                  c_line->state = SHARED_STATE;
-                  break;
-               default:
-                  printf("error_info : mesiStateTransition function called with an unknown state\n");
-                  exit(-1);
-                  break;
-            }
-            break;
-         case REMOTE_WRITE_HIT:
-            switch(current_state)
-            {
-               case SHARED_STATE:
-                  c_line->state = INVALID_STATE;
-                  break;
-               default:
-                  {printf("error_info : REMOTE_WRITE_HIT on a not SHARED_STATE block\n"); exit(-1);}
-                 
-            }
-         case REMOTE_WRITE_MISS:
-            switch(current_state)
-            {
-               case INVALID_STATE:
-                  printf("error_info : REMOTE_WRITE_MISS on a INVALID_STATE\n");
-                  exit(-1);
-                  break;
-               case EXCLUSIVE_STATE:
-               case MODIFIED_STATE:
-               case SHARED_STATE:
-                  c_line->state = INVALID_STATE;
-                  break;
-               default:
-                  printf("error_info : mesiStateTransition function called with an unknown state\n");
-                  exit(-1);
-                  break;
-            }
-            break;
-         default:
-            printf("error_info : Unknown transition instigator or broadcast\n");
-            exit(-1);
-            break; 
-      }
+      printf("error_info : Unknown transition instigator or broadcast\n");
+      exit(-1);
+   }
+   t = &proto->table[whatHappened][*state];
+   if(t->flags & T_ERROR)
+   {
+      printf("error_info : %s event %d on a block in state %c\n", proto->name, whatHappened, stateSymbol(*state));
+      exit(-1);
    }
+   if(t->flags & T_COPY_BACK)
+      mesi_cache_stat[pid].copies_back += mesi_cache[pid].block_size/WORD_SIZE;
+   *state = t->next;
+   PROF_END(PROF_TRANSITION, t_transition);
+   return t->flags & T_COPY_BACK;
 }
 
-void mesiST_Local(Pcache_line c_line, unsigned whatHappened)
+void mesiST_Local(unsigned char *state, unsigned whatHappened)
 {
-   unsigned current_state;
-   if(c_line == NULL)
+   const transition *t;
+   PROF_START(t_transition);
+   if(state == NULL)
    {
       printf("error_info : mesiStateTransition funciton called on an unallocated cache line\n");
       exit(-1);
    }
-   else
+   if(whatHappened > WRITE_MISS_FROM_MEMORY)
    {
-      current_state  = c_line->state;
-      switch(whatHappened)
-      {
-         case READ_HIT:
-            switch(current_state)
-            {
-               case INVALID_STATE: //Hit should not occur on an INVALID current state
-                  printf("error_info : READ_HIT on an invalid state\n");
-                  exit(-1);
-                  break;
-               case EXCLUSIVE_STATE:
-               case MODIFIED_STATE:
-               case SHARED_STATE:
-                  c_line->state = current_state; //Stay in current state on a read hit
-                  break;
-            }
-            break;
-        case READ_MISS_FROM_BUS:
-            c_line->state = SHARED_STATE;
-            break;
-         case READ_MISS_FROM_MEMORY:
-            c_line->state = EXCLUSIVE_STATE;
-            break;
-         case WRITE_MISS_FROM_BUS:
-         case WRITE_MISS_FROM_MEMORY:
-            c_line->state = MODIFIED_STATE; //Move the current state to MODIFIED on a write miss
-            break;
-         case WRITE_HIT:
-            switch(current_state)
-            {
-               case INVALID_STATE: //Hit should not occur on an INVALID current state
-                  printf("error_info : WRITE_HIT on an invalid state\n");
-                  exit(-1);
-                  break;
-               case MODIFIED_STATE:
-               case EXCLUSIVE_STATE:
-               case SHARED_STATE:
-                  c_line->state = MODIFIED_STATE; //Move the current state to MODIFIED on a write hit
-                  break;
-               default:
-                  printf("error_info : mesiStateTransition function called with an unknown state\n");
-                  exit(-1);
-                  break;
-            }
-            break;
-         default:
-             printf("error_info : Unknown transition instigator or broadcast\n");
-             exit(-1);
-             break; 
-      }
+      printf("error_info : Unknown transition instigator or broadcast\n");
+      exit(-1);
+   }
+   t = &proto->table[whatHappened][*state];
+   if(t->flags & T_ERROR)
+   {
+      printf("error_info : %s event %d on a block in state %c\n", proto->name, whatHappened, stateSymbol(*state));
+      exit(-1);
    }
+   *state = t->next;
+   PROF_END(PROF_TRANSITION, t_transition);
 }
 
 
-//Search whether tag is present in the double linked list cache line c
+//Search whether tag is present in set index of cache c
 //Tri-state search
-int search(Pcache_line c, unsigned tag, Pcache_line *hitAt)
+int search(Pcache c, unsigned index, unsigned long long tag, int *hitAt)
 {
-   Pcache_line n;
-   if(c == NULL)
-   {
-      printf("error : Searching an unintialized cache line\n");
-      exit(-1);
-   }
-   else
-   {
-      *hitAt = (Pcache_line)NULL;
-      if(c->tag == tag)
-      {
-         *hitAt = c;
-         if(c->state == INVALID_STATE)
-            return TAG_HIT_INVALID;
-         else
-            return TAG_HIT_VALID;
-      }
-      else
-      {
-         while(c->LRU_next != NULL)
-         {
-            n = c->LRU_next;
-            if(n->tag == tag)
-            {
-               *hitAt = n;
-               if(n->state == INVALID_STATE)
-                  return TAG_HIT_INVALID;
-               else
-                  return TAG_HIT_VALID;
-            }
-            c = n;
-         }
-      }
-      return TAG_MISS;
-   }
+   return search_ways(c, index, tag, hitAt, c->associativity);
 }
 
 
-void BroadcastnSetState(unsigned request_type, unsigned tag, unsigned index, unsigned pid, Pcache_line c_line, int isHit)
+//Returns the SNOOP_ result of the broadcast
+int BroadcastnSetState(unsigned request_type, unsigned long long tag, unsigned index, unsigned pid, unsigned char *state, int isHit)
 {
+   int snoop = SNOOP_NONE, words = mesi_cache[pid].block_size/WORD_SIZE;
    if(debug) fprintf(cacheLog, "(broadcast) ");
    if(request_type == READ_REQUEST)
    {
       if(isHit) {printf("error_info : There should not be a broadcast on a READ HIT\n"); exit(-1);}
 
-      if(BroadcastnSearch(tag, index, REMOTE_READ_MISS, pid)) //If data to be read present in other core caches
+      snoop = BroadcastnSearch(tag, index, REMOTE_READ_MISS, pid);
+      if(prefetch_issue)
+         mesi_cache_stat[pid].prefetch_fetches += words;
+      else
+         mesi_cache_stat[pid].demand_fetches += words;
+      if(snoop != SNOOP_SUPPLIED) //No cache supplies the block, do a Memory fetch
+         mesi_cache_stat[pid].fetches_from_memory += words;
+      if(snoop != SNOOP_NONE) //If data to be read present in other core caches
       {
-         mesi_cache_stat[pid].demand_fetches += cache_block_size/WORD_SIZE;
-         mesiST_Local(c_line, READ_MISS_FROM_BUS);
-         if(debug) fprintf(cacheLog, "Is a READ_MISS got FROM_BUS\n");
+         mesiST_Local(state, READ_MISS_FROM_BUS);
+         if(debug) fprintf(cacheLog, "Is a READ_MISS got %s\n", snoop == SNOOP_SUPPLIED ? "FROM_BUS" : "FROM_MEMORY (shared)");
       }
       else
       {
-         mesi_cache_stat[pid].fetches_from_memory += cache_block_size/WORD_SIZE; //Else do a Memory fetch
-         mesi_cache_stat[pid].demand_fetches += cache_block_size/WORD_SIZE; 
-         mesiST_Local(c_line, READ_MISS_FROM_MEMORY);
+         mesiST_Local(state, READ_MISS_FROM_MEMORY);
          if(debug) fprintf(cacheLog, "Is a READ_MISS got FROM_MEMORY\n");
       }
    }
@@ -656,23 +2073,24 @@ void BroadcastnSetState(unsigned request_type, unsigned tag, unsigned index, uns
    {
       if(isHit) //WRITE_HIT
       {
-         BroadcastnSearch(tag, index, REMOTE_WRITE_HIT, pid); //Broadcast in case of a REMOTE_WRITE_HIT
-         mesiST_Local(c_line, WRITE_HIT);
+         snoop = BroadcastnSearch(tag, index, REMOTE_WRITE_HIT, pid); //Broadcast in case of a REMOTE_WRITE_HIT
+         mesiST_Local(state, WRITE_HIT);
          if(debug) fprintf(cacheLog, "Is a WRITE_HIT\n");
       }
       else //WRITE_MISS
       {
-         if(BroadcastnSearch(tag, index, REMOTE_WRITE_MISS, pid))
+         snoop = BroadcastnSearch(tag, index, REMOTE_WRITE_MISS, pid);
+         mesi_cache_stat[pid].demand_fetches += words;
+         if(snoop != SNOOP_SUPPLIED)
+            mesi_cache_stat[pid].fetches_from_memory += words;
+         if(snoop != SNOOP_NONE) //If data to be present is in other core caches
          {
-            mesi_cache_stat[pid].demand_fetches += cache_block_size/WORD_SIZE; //If data to be present is in other core caches
-            mesiST_Local(c_line, WRITE_MISS_FROM_BUS);
+            mesiST_Local(state, WRITE_MISS_FROM_BUS);
             if(debug) fprintf(cacheLog, "Is a WRITE_MISS_FROM_BUS\n");
          }
          else
          {
-            mesi_cache_stat[pid].fetches_from_memory += cache_block_size/WORD_SIZE; //Else do a Memory fetch
-            mesi_cache_stat[pid].demand_fetches += cache_block_size/WORD_SIZE;
-            mesiST_Local(c_line, WRITE_MISS_FROM_MEMORY);
+            mesiST_Local(state, WRITE_MISS_FROM_MEMORY);
             if(debug) fprintf(cacheLog, "Is a WRITE_MISS_FROM_MEMORY\n");
          }
       }
@@ -682,19 +2100,88 @@ void BroadcastnSetState(unsigned request_type, unsigned tag, unsigned index, uns
       printf("error_info : Unknow request type in BroadcasenSetState\n");
       exit(-1);
    }
+   return snoop;
+}
+
+
+
+//Snoop filter functions
+#define DIR_HASH(block) ((unsigned)(((block) * 0x9E3779B97F4A7C15ULL) >> 32) & dir_mask)
+
+//Returns the slot tracking block, -1 if no core holds it
+int dir_find(unsigned long long block)
+{
+   unsigned slot;
+   for(slot = DIR_HASH(block); dir_count[slot]; slot = (slot + 1) & dir_mask)
+      if(dir_blocks[slot] == block)
+         return slot;
+   return -1;
+}
+
+void dir_add(unsigned long long block, unsigned pid)
+{
+   unsigned slot;
+   unsigned long long *bits;
+   for(slot = DIR_HASH(block); dir_count[slot]; slot = (slot + 1) & dir_mask)
+      if(dir_blocks[slot] == block)
+         break;
+   dir_blocks[slot] = block;
+   bits = &dir_bits[(size_t)slot * sharer_words + pid / 64];
+   if(!(*bits & (1ULL << (pid % 64))))
+   {
+      *bits |= 1ULL << (pid % 64);
+      dir_count[slot]++;
+   }
 }
 
+//Drops pid from the sharers of block, freeing the slot once no core holds
+//it. Freed slots are refilled by shifting back later entries of the probe
+//sequence so lookups never need tombstones.
+void dir_remove(unsigned long long block, unsigned pid)
+{
+   unsigned slot, next, home;
+   int slot_found = dir_find(block);
+   if(slot_found < 0)
+      {printf("error_info : dir_remove on an untracked block\n"); exit(-1);}
+
+   slot = slot_found;
+   dir_bits[(size_t)slot * sharer_words + pid / 64] &= ~(1ULL << (pid % 64));
+   if(--dir_count[slot])
+      return;
+
+   for(next = (slot + 1) & dir_mask; dir_count[next]; next = (next + 1) & dir_mask)
+   {
+      home = DIR_HASH(dir_blocks[next]);
+      if(((next - home) & dir_mask) >= ((next - slot) & dir_mask))
+      {
+         //Emptied bitmaps are all zero, so moving an entry leaves a clean slot
+         dir_blocks[slot] = dir_blocks[next];
+         dir_count[slot] = dir_count[next];
+         memcpy(&dir_bits[(size_t)slot * sharer_words], &dir_bits[(size_t)next * sharer_words], sizeof(unsigned long long)*sharer_words);
+         memset(&dir_bits[(size_t)next * sharer_words], 0, sizeof(unsigned long long)*sharer_words);
+         dir_count[next] = 0;
+         slot = next;
+      }
+   }
+}
 
 
 //Debug functions
-void printCL(Pcache_line c_line)
+void printCL(Pcache c, unsigned index)
 {
-Pcache_line n_line;
-while(c_line)
+int base, rank, way;
+if(!debug) return;
+base = index * c->associativity;
+if(c->policy != REPL_LRU) //Only LRU orders the lines, list them by way
+{
+   for(way = 0; way < c->set_contents[index]; way++)
+      fprintf(cacheLog, "|%c %llx|", stateSymbol(c->states[base + way]), c->tags[base + way]);
+   return;
+}
+for(rank = 0; rank < c->set_contents[index]; rank++) //Most recently used line first
 {
-   fprintf(cacheLog, "|%c %x|", stateSymbol(c_line->state), c_line->tag);
-   n_line = c_line->LRU_next;
-   c_line = n_line;
+   for(way = 0; c->ranks[base + way] != rank; way++);
+   fprintf(cacheLog, "|%c %llx|", stateSymbol(c->states[base + way]), c->tags[base + way]);
 }
 }
 
@@ -702,17 +2189,15 @@ while(c_line)
 void PrintCache(unsigned n_sets)
 {
    int i, pid;
+   if(!debug) return; //No log outside the debug build
    fprintf(cacheLog, "**************************************************************************************************************************\n");
-   for(i = 0; i < n_sets; i++)
+   for(i = 0; i < (int)n_sets; i++)
    {
       fprintf(cacheLog, "Line %d : ", i);
       for(pid = 0; pid < num_core; pid++)
       {
          fprintf(cacheLog, " {");
-         if(mesi_cache[pid].LRU_head[i] != NULL)
-         {
-            printCL(mesi_cache[pid].LRU_head[i]);
-         }
+         if(i < mesi_cache[pid].n_sets) printCL(&mesi_cache[pid], i);
          fprintf(cacheLog, "} ");
       }
       fprintf(cacheLog, "\n");
@@ -723,8 +2208,9 @@ void PrintCache(unsigned n_sets)
 void PrintLiveStats()
 {
 int i;
-int total_accesses = 0, total_misses = 0, total_replacements = 0, total_demand_fetches = 0, total_copies_back = 0, total_broadcasts = 0;
-int total_fetches_from_memory = 0;
+long long total_accesses = 0, total_misses = 0, total_replacements = 0, total_demand_fetches = 0, total_copies_back = 0, total_broadcasts = 0;
+long long total_fetches_from_memory = 0;
+if(!debug) return;
 fprintf(cacheLog, "**************************************************************************************************************************\n");
 for (i = 0; i < num_core; i++)
 {
@@ -738,25 +2224,25 @@ for (i = 0; i < num_core; i++)
  
     fprintf(cacheLog, "(");
     fprintf(cacheLog, "C%d: ", i);
-    fprintf(cacheLog, "a=%d,", mesi_cache_stat[i].accesses);
-    fprintf(cacheLog, "m=%d,", mesi_cache_stat[i].misses);
-    fprintf(cacheLog, "r=%d,", mesi_cache_stat[i].replacements);
-    fprintf(cacheLog, "d=%d,", mesi_cache_stat[i].demand_fetches);
-    fprintf(cacheLog, "f=%d,", mesi_cache_stat[i].fetches_from_memory);
-    fprintf(cacheLog, "b=%d,", mesi_cache_stat[i].broadcasts);
-    fprintf(cacheLog, "c=%d", mesi_cache_stat[i].copies_back);
+    fprintf(cacheLog, "a=%lld,", mesi_cache_stat[i].accesses);
+    fprintf(cacheLog, "m=%lld,", mesi_cache_stat[i].misses);
+    fprintf(cacheLog, "r=%lld,", mesi_cache_stat[i].replacements);
+    fprintf(cacheLog, "d=%lld,", mesi_cache_stat[i].demand_fetches);
+    fprintf(cacheLog, "f=%lld,", mesi_cache_stat[i].fetches_from_memory);
+    fprintf(cacheLog, "b=%lld,", mesi_cache_stat[i].broadcasts);
+    fprintf(cacheLog, "c=%lld", mesi_cache_stat[i].copies_back);
     fprintf(cacheLog, ") ");
     
 }
 fprintf(cacheLog, "(");
 fprintf(cacheLog, "C: ");
-fprintf(cacheLog, "a=%d,", total_accesses);
-fprintf(cacheLog, "m=%d,", total_misses);
-fprintf(cacheLog, "r=%d,", total_replacements);
-fprintf(cacheLog, "d=%d,", total_demand_fetches);
-fprintf(cacheLog, "f=%d,", total_fetches_from_memory);
-fprintf(cacheLog, "b=%d,", total_broadcasts);
-fprintf(cacheLog, "c=%d", total_copies_back);
+fprintf(cacheLog, "a=%lld,", total_accesses);
+fprintf(cacheLog, "m=%lld,", total_misses);
+fprintf(cacheLog, "r=%lld,", total_replacements);
+fprintf(cacheLog, "d=%lld,", total_demand_fetches);
+fprintf(cacheLog, "f=%lld,", total_fetches_from_memory);
+fprintf(cacheLog, "b=%lld,", total_broadcasts);
+fprintf(cacheLog, "c=%lld", total_copies_back);
 fprintf(cacheLog, ") ");
 fprintf(cacheLog, "\n");
 }
@@ -777,6 +2263,12 @@ char stateSymbol(unsigned state)
       case MODIFIED_STATE:
          return 'M';
          break;
+      case OWNED_STATE:
+         return 'O';
+         break;
+      case FORWARD_STATE:
+         return 'F';
+         break;
       default:
          printf("invalid state input to stateSymbol\n");
          exit(-1);
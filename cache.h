@@ -10,6 +10,9 @@
 #define DEFAULT_CACHE_WRITEBACK TRUE
 #define DEFAULT_CACHE_WRITEALLOC TRUE
 #define DEFAULT_NUM_CORE 1
+#define DEFAULT_L2_ASSOC 8
+#define DEFAULT_LLC_ASSOC 16
+#define MAX_CORE_GROUPS 16	/* -cores geometries */
 
 /* constants for settting cache parameters */
 #define NUM_CORE 0
@@ -17,19 +20,51 @@
 #define CACHE_PARAM_USIZE 2
 #define CACHE_PARAM_ASSOC 3
 #define PARAM_DEBUG 4 
+#define PARAM_SNOOP_FILTER 5
+#define PARAM_PROTOCOL 6
+#define PARAM_L2_USIZE 7
+#define PARAM_L2_ASSOC 8
+#define PARAM_LLC_USIZE 9
+#define PARAM_LLC_ASSOC 10
+#define PARAM_LLC_POLICY 11
+#define PARAM_TIMING 12
+#define PARAM_CLASSIFY 13
+#define PARAM_HOT 14
+#define PARAM_REPL 15
+#define PARAM_PREFETCH 16
+#define PARAM_PREFETCH_DEGREE 17
+#define CACHE_PARAM_WRITEBACK 18
+#define CACHE_PARAM_WRITETHROUGH 19
+#define CACHE_PARAM_WRITEALLOC 20
+#define CACHE_PARAM_NOWRITEALLOC 21
+#define PARAM_WBUF 22
+#define PARAM_LAT_HIT 23	/* the latencies of -lat, in its order */
+#define PARAM_LAT_C2C 24
+#define PARAM_LAT_MEM 25
+#define PARAM_LAT_L2 26
+#define PARAM_LAT_LLC 27
+#define PARAM_BUS_WIDTH 28
+#define PARAM_BUS_ARB 29
+#define N_PARAMS 30
+#define N_LATENCIES (PARAM_LAT_LLC - PARAM_LAT_HIT + 1)
 
 #define DATA_LOAD_REFERENCE 0
 #define DATA_STORE_REFERENCE 1
 #define INSTRUCTION_LOAD_REFERENCE 2
 
+/* trace records the caches see, the others being skipped */
+#define IS_ACCESS(r) ((r)->access_type == DATA_LOAD_REFERENCE || (r)->access_type == DATA_STORE_REFERENCE)
+
 #define READ_REQUEST 0
 #define WRITE_REQUEST 1
 
-/* MESI protocol state */
+/* coherence states, see protocol.h */
 #define INVALID_STATE 0
 #define EXCLUSIVE_STATE 1
 #define SHARED_STATE 2
 #define MODIFIED_STATE 3
+#define OWNED_STATE 4		/* MOESI only */
+#define FORWARD_STATE 5		/* MESIF only */
 
 /* Type of state transition instigators */
 #define READ_HIT 0
@@ -44,69 +79,224 @@
 #define REMOTE_WRITE_HIT 7
 #define REMOTE_WRITE_MISS 8
 
+/* BroadcastnSearch results */
+#define SNOOP_NONE 0		/* no other core holds the block */
+#define SNOOP_SHARED 1		/* copies exist, none that supplies data */
+#define SNOOP_SUPPLIED 2	/* a remote cache supplies the block */
+
+/* where a missing block was filled from */
+#define FILL_PEER 0		/* another core's private cache */
+#define FILL_L2 1
+#define FILL_LLC 2
+#define FILL_DRAM 3
+
+/* phases of a sampled simulation, see set_phase() */
+#define PHASE_FAST_FORWARD 0
+#define PHASE_WARM_UP 1
+#define PHASE_MEASURE 2
+
 #define TAG_MISS 0
 #define TAG_HIT_VALID 1
 #define TAG_HIT_INVALID 2
 
 #define DEFAULT_DEBUG FALSE
+#define DEFAULT_SNOOP_FILTER FALSE
 #define MORE_STATS FALSE 
 
 /* structure definitions */
-typedef struct cache_line_ {
-  unsigned tag;
-  int state;
-
-  struct cache_line_ *LRU_next;
-  struct cache_line_ *LRU_prev;
-} cache_line, *Pcache_line;
-
+/* Each core's tag store is a flat struct-of-arrays: line (set, way) lives at
+   slot set * associativity + way of tags/states/ranks. Ways 0..set_contents-1
+   of a set are filled; ranks order them for LRU, 0 being most recently used.
+   The other replacement policies keep a word of state per set in repl
+   instead, see repl.h. Every core has its own geometry, see -cores. */
 typedef struct cache_ {
   int id;                       /* core ID */
   int size;			/* cache size */
   int associativity;		/* cache associativity */
+  int block_size;
   int n_sets;			/* number of cache sets */
-  unsigned index_mask;		/* mask to find cache index */
+  unsigned long long index_mask;	/* mask to find cache index */
   int index_mask_offset;	/* number of zero bits in mask */
-  Pcache_line *LRU_head;	/* head of LRU list for each set */
-  Pcache_line *LRU_tail;	/* tail of LRU list for each set */
+  int tag_shift;		/* index_mask_offset + LOG2(n_sets) */
+  int set_bits;			/* LOG2(n_sets) */
+  int granule_shift;		/* LOG2 of snoop filter granules per block */
+  unsigned long long *tags;	/* tag of each line */
+  unsigned char *states;	/* coherence state of each line */
+  unsigned char *ranks;		/* LRU rank of each line within its set */
   int *set_contents;		/* number of valid entries in set */
+  int policy;			/* REPL_ replacement policy */
+  unsigned long long *repl;	/* replacement state of each set */
+  unsigned *seeds;		/* random generator of each set */
 } cache, *Pcache;
 
 typedef struct cache_stat_ {
-  int accesses;			/* number of memory references */
-  int misses;			/* number of cache misses */
-  int replacements;		/* number of misses that cause replacments */
-  int demand_fetches;		/* number of fetches */
-  int copies_back;		/* number of write backs */
-  int fetches_from_memory;       /* number of fetches into cache */ 
-  int broadcasts;               /* number of broadcasts */
-  int read_requests;            /* number of read requests */
-  int write_requests;           /* number of write requests */
+  long long accesses;		/* number of memory references */
+  long long misses;		/* number of cache misses */
+  long long replacements;	/* number of misses that cause replacments */
+  long long demand_fetches;	/* number of fetches */
+  long long copies_back;	/* number of write backs */
+  long long fetches_from_memory;	/* number of fetches into cache */
+  long long broadcasts;		/* number of broadcasts */
+  long long read_requests;	/* number of read requests */
+  long long write_requests;	/* number of write requests */
+  long long snoops;		/* number of remote caches probed */
+  long long snoops_wasted;	/* broadcast probes that find no valid copy */
+  long long l2_accesses;	/* misses looked up in the private L2 */
+  long long l2_misses;
+  long long llc_accesses;	/* lookups in the shared LLC */
+  long long llc_misses;
+  long long dram_fetches;	/* words read from DRAM */
+  long long dram_copies_back;	/* words written to DRAM */
+  long long back_invalidations;	/* private copies dropped by LLC evictions */
+  long long cycles;		/* summed latency of all references */
+  long long bus_wait;		/* cycles references waited for the bus */
+  long long compulsory_misses;	/* miss classes, see classify.h */
+  long long capacity_misses;
+  long long conflict_misses;
+  long long true_sharing_misses;
+  long long false_sharing_misses;
+  long long prefetches;		/* prefetches issued, see prefetch.h */
+  long long prefetch_hits;	/* prefetched lines a demand reference used */
+  long long prefetch_late;	/* of which were still in flight */
+  long long prefetch_invalidated;	/* prefetched lines invalidated unused */
+  long long prefetch_distance;	/* references from issue to first use, summed */
+  long long prefetch_fetches;	/* words fetched by prefetches */
+  long long prefetch_broadcasts;	/* broadcasts issued by prefetches */
+  long long write_throughs;	/* stores written through or around the cache */
+  long long write_words;	/* words they wrote to memory, see wbuf.h */
+  long long write_transactions;	/* bus transactions that wrote them */
 } cache_stat, *Pcache_stat;
 
+/* unused ways of a set: no address has an all ones tag, since tags drop at
+   least the word offset bits, and no line in use has a rank above 254 */
+#define EMPTY_TAG (~0ULL)
+#define EMPTY_RANK 255
+
+/* checkpoint file header, followed by the size, associativity and block
+   size of every core, each core's set_contents, tags, states, ranks,
+   replacement state and seeds, then the cache_stat of every core */
+#define CKPT_MAGIC "CA4CKPT"
+#define CKPT_VERSION 10
+
+typedef struct ckpt_header_ {
+  char magic[8];		/* CKPT_MAGIC, NUL terminated */
+  int version;
+  int num_core;
+  int cache_usize;
+  int cache_block_size;
+  int cache_assoc;
+  int snoop_filter;
+  int protocol;
+  int repl;			/* REPL_ replacement policy */
+  int writeback;		/* FALSE for -wt */
+  int writealloc;		/* FALSE for -nw */
+  long long ref_count;
+  long long num_inst;		/* trace records consumed */
+  long long trace_offset;	/* file offset of the next trace record */
+} ckpt_header;
+
+typedef void (*access_fn)(unsigned long long addr, unsigned access_type, unsigned pid);
+struct trace_record_;		/* see trace.h */
+typedef void (*batch_fn)(struct trace_record_ *rec, int n);
+
+/* complete state of one simulated configuration, so that several can be
+   interleaved over a single pass of the trace */
+typedef struct cache_context_ {
+  int cache_usize;
+  int cache_block_size;
+  int words_per_block;
+  int cache_assoc;
+  int cache_writeback;
+  int cache_writealloc;
+  int num_core;
+  Pcache mesi_cache;
+  Pcache_stat mesi_cache_stat;
+  long long ref_count;
+  int snoop_filter;
+  int protocol;
+  int repl_policy;
+  unsigned long long *dir_blocks;
+  int *dir_count;
+  unsigned long long *dir_bits;
+  unsigned dir_mask;
+  int sharer_words;
+  unsigned long long *sharers;
+  int uniform;
+  int max_sets;
+  access_fn access_kernel;
+  batch_fn batch_kernel;
+  int debug;
+  int l2_usize, l2_assoc, llc_usize, llc_assoc, llc_policy, hierarchy;
+  int lat[N_LATENCIES], bus_width, bus_arb, timing;
+  int classify;
+  int hot_k, hot;
+  int phase, enabled_timing, enabled_classify, enabled_hot;
+  int prefetch_kind, prefetch_degree, prefetcher;
+  int wbuf_entries, wbuf;
+  /* the state of the models of the other modules, NULL for those off */
+  struct hier_context_ *hier_model;
+  struct timing_context_ *timing_model;
+  struct classify_context_ *classify_model;
+  struct hot_context_ *hot_model;
+  struct prefetch_context_ *prefetch_model;
+  struct wbuf_context_ *wbuf_model;
+} cache_context, *Pcache_context;
+
 
 /* function prototypes */
 void set_cache_param();
+char *cache_param_error(int param, int value);
+char *config_error();
+char *core_group_error(int first, int last, int usize, int assoc, int block_size);
+void set_core_geometry(int first, int last, int usize, int assoc, int block_size);
 void init_cache();
-void perform_access(unsigned addr, unsigned access_type, unsigned pid);
+void perform_access(unsigned long long addr, unsigned access_type, unsigned pid);
+void perform_batch(struct trace_record_ *rec, int n);
+void prefetch_block(unsigned long long block, unsigned pid);
+access_fn select_kernel(int assoc, int block_size, batch_fn *batch);
+void write_checkpoint(char *file, long long num_inst, long long trace_offset);
+void read_checkpoint(char *file, long long *num_inst, long long *trace_offset);
+void set_phase(int next);
 void flush();
-void delete(Pcache_line *, Pcache_line *, Pcache_line);
-void insert(Pcache_line *, Pcache_line *, Pcache_line);
+void touch(Pcache c, unsigned index, int line);
+int lru_victim(Pcache c, unsigned index);
+int insert(Pcache c, unsigned index, unsigned long long tag);
 void dump_settings();
 void print_stats();
+void print_hierarchy_stats(long long demand_fetches);
+void print_stats_header();
+void print_stats_row();
+void save_context(Pcache_context ctx);
+void load_context(Pcache_context ctx);
+void reset_cache_params();
+void free_context(Pcache_context ctx);
+void split_context(Pcache_context shard, int shard_sets);
+void merge_context(Pcache_context shard);
+void add_stats(Pcache_stat dst, Pcache_stat src);
+Pcache_stat swap_stats(Pcache_stat stats);
+unsigned set_index(unsigned long long addr);
+int num_sets();
+int num_cores();
+void current_config(int *usize, int *assoc, int *block_size, char **protocol, char **repl);
+Pcache_stat core_stats(int pid);
+int held_in_l1(unsigned long long block);
+int back_invalidate(unsigned long long block, int *dirty);
+void init_directory(long entries);
 
 
 /* macros */
 #define LOG2(x) ((int)( log((double)(x)) / log(2) ))
 
-Pcache_line allocateCL(unsigned tag);
 unsigned isReadorWrite(unsigned access_type, unsigned pid);
-int BroadcastnSearch(unsigned tag, unsigned index, unsigned broadcast_type, unsigned pid);
-void mesiST_Remote(Pcache_line c_line, unsigned whatHappened, unsigned pid);
-void mesiST_Local(Pcache_line c_line, unsigned whatHappened);
-int search(Pcache_line c, unsigned tag, Pcache_line *hitAt);
-void BroadcastnSetState(unsigned request_type, unsigned tag, unsigned index, unsigned pid, Pcache_line c_line, int isHit);
-void printCL(Pcache_line c_line);
+int BroadcastnSearch(unsigned long long tag, unsigned index, unsigned broadcast_type, unsigned pid);
+int mesiST_Remote(unsigned char *state, unsigned whatHappened, unsigned pid);
+void mesiST_Local(unsigned char *state, unsigned whatHappened);
+int search(Pcache c, unsigned index, unsigned long long tag, int *hitAt);
+int BroadcastnSetState(unsigned request_type, unsigned long long tag, unsigned index, unsigned pid, unsigned char *state, int isHit);
+void printCL(Pcache c, unsigned index);
 void PrintCache(unsigned n_sets);
 char stateSymbol(unsigned state);
 void PrintLiveStats();
+int dir_find(unsigned long long block);
+void dir_add(unsigned long long block, unsigned pid);
+void dir_remove(unsigned long long block, unsigned pid);
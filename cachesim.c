@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cachesim.h"
+#include "stats.h"
+
+typedef struct cachesim_ {
+  int n_params;				/* cachesim_set calls, replayed in order */
+  int param[MAX_SIM_PARAMS];
+  int value[MAX_SIM_PARAMS];
+  int n_groups;				/* cachesim_set_cores calls */
+  int groups[MAX_CORE_GROUPS][5];
+  int built;				/* the first access has built the model */
+  pthread_t owner;			/* thread that built it */
+  int num_core;
+  cache_context ctx;			/* the model while another handle runs */
+  char error[160];			/* message of the last failed call */
+} cachesim;
+
+/* handle whose model the statics of cache.c hold on this thread */
+static __thread Pcachesim current;
+
+/************************************************************/
+Pcachesim cachesim_create()
+{
+  return (Pcachesim)calloc(1, sizeof(cachesim));
+}
+
+/* records why a call on sim failed and returns its result */
+static int fail(Pcachesim sim, int result, char *fn, const char *msg)
+{
+  snprintf(sim->error, sizeof(sim->error), "%s: %s", fn, msg);
+  return result;
+}
+
+const char *cachesim_error(Pcachesim sim)
+{
+  return sim->error;
+}
+
+/* takes any parameter of set_cache_param() */
+int cachesim_set(Pcachesim sim, int param, int value)
+{
+  char *msg;
+
+  if (sim->built)
+    return fail(sim, CACHESIM_BUILT, "cachesim_set", "parameters cannot change after the first access");
+  if (param < 0 || param >= N_PARAMS)
+    return fail(sim, CACHESIM_UNSUPPORTED, "cachesim_set", "unknown parameter");
+  if ((msg = cache_param_error(param, value)) != NULL)
+    return fail(sim, CACHESIM_BAD_VALUE, "cachesim_set", msg);
+  if (sim->n_params == MAX_SIM_PARAMS)
+    return fail(sim, CACHESIM_BAD_VALUE, "cachesim_set", "too many parameters for one handle");
+  sim->param[sim->n_params] = param;
+  sim->value[sim->n_params] = value;
+  sim->n_params++;
+  return CACHESIM_OK;
+}
+
+/* the handle's equivalent of -cores, see set_core_geometry() */
+int cachesim_set_cores(Pcachesim sim, int first, int last, int usize, int assoc, int block_size)
+{
+  char *msg;
+  int *g;
+
+  if (sim->built)
+    return fail(sim, CACHESIM_BUILT, "cachesim_set_cores", "parameters cannot change after the first access");
+  if ((msg = core_group_error(first, last, usize, assoc, block_size)) != NULL)
+    return fail(sim, CACHESIM_BAD_VALUE, "cachesim_set_cores", msg);
+  if (sim->n_groups == MAX_CORE_GROUPS)
+    return fail(sim, CACHESIM_BAD_VALUE, "cachesim_set_cores", "too many core groups");
+  g = sim->groups[sim->n_groups++];
+  g[0] = first;
+  g[1] = last;
+  g[2] = usize;
+  g[3] = assoc;
+  g[4] = block_size;
+  return CACHESIM_OK;
+}
+/************************************************************/
+
+/************************************************************/
+/* Makes sim the model of this thread, saving the one it replaces. The
+   first time, its parameters are replayed onto the defaults and the model
+   is built, unless they cannot be simulated together. */
+static int switch_sim(Pcachesim sim, char *fn)
+{
+  char *msg;
+  int i, *g;
+
+  if (sim->built && !pthread_equal(sim->owner, pthread_self()))
+    return fail(sim, CACHESIM_OTHER_THREAD, fn, "the handle belongs to another thread");
+  if (current)
+    save_context(&current->ctx);
+  current = NULL;
+  if (sim->built) {
+    load_context(&sim->ctx);
+    current = sim;
+    return CACHESIM_OK;
+  }
+
+  reset_cache_params();
+  for (i = 0; i < sim->n_params; i++)
+    set_cache_param(sim->param[i], sim->value[i]);
+  for (i = 0; i < sim->n_groups; i++) {
+    g = sim->groups[i];
+    set_core_geometry(g[0], g[1], g[2], g[3], g[4]);
+  }
+  if ((msg = config_error()) != NULL)
+    return fail(sim, CACHESIM_BAD_CONFIG, fn, msg);
+  init_cache();
+  sim->num_core = num_cores();
+  sim->owner = pthread_self();
+  sim->built = TRUE;
+  current = sim;
+  return CACHESIM_OK;
+}
+
+static inline int select_sim(Pcachesim sim, char *fn)
+{
+  return sim == current ? CACHESIM_OK : switch_sim(sim, fn);
+}
+
+int cachesim_access(Pcachesim sim, unsigned long long addr, unsigned access_type, unsigned pid)
+{
+  int result = select_sim(sim, "cachesim_access");
+
+  if (result != CACHESIM_OK)
+    return result;
+  if (pid >= (unsigned)sim->num_core)
+    return fail(sim, CACHESIM_BAD_CORE, "cachesim_access", "no such core");
+  perform_access(addr, access_type, pid);
+  return CACHESIM_OK;
+}
+
+/* runs none of the records if any load or store names a missing core */
+int cachesim_access_batch(Pcachesim sim, trace_record *rec, int n)
+{
+  int i, result = select_sim(sim, "cachesim_access_batch");
+
+  if (result != CACHESIM_OK)
+    return result;
+  for (i = 0; i < n; i++)
+    if (IS_ACCESS(&rec[i]) && rec[i].pid >= sim->num_core)
+      return fail(sim, CACHESIM_BAD_CORE, "cachesim_access_batch", "no such core");
+  perform_batch(rec, n);
+  return CACHESIM_OK;
+}
+
+/* ends the run: dirty lines are counted as written back, once */
+int cachesim_flush(Pcachesim sim)
+{
+  int result = select_sim(sim, "cachesim_flush");
+
+  if (result != CACHESIM_OK)
+    return result;
+  flush();
+  return CACHESIM_OK;
+}
+/************************************************************/
+
+/************************************************************/
+/* copies the counters of core pid into st, summed over every core for -1 */
+int cachesim_stats(Pcachesim sim, int pid, Pcache_stat st)
+{
+  int result = select_sim(sim, "cachesim_stats");
+
+  if (result != CACHESIM_OK)
+    return result;
+  if (pid < -1 || pid >= sim->num_core)
+    return fail(sim, CACHESIM_BAD_CORE, "cachesim_stats", "no such core");
+  if (pid < 0)
+    total_stats(st);
+  else
+    memcpy(st, core_stats(pid), sizeof(cache_stat));
+  return CACHESIM_OK;
+}
+
+/* the text report of the sim binary, on stdout */
+int cachesim_print_stats(Pcachesim sim)
+{
+  int result = select_sim(sim, "cachesim_print_stats");
+
+  if (result != CACHESIM_OK)
+    return result;
+  print_stats();
+  return CACHESIM_OK;
+}
+
+/* a handle never built, by a bad configuration or no access, has no
+   model to free */
+int cachesim_destroy(Pcachesim sim)
+{
+  int result;
+
+  if (sim->built) {
+    if ((result = select_sim(sim, "cachesim_destroy")) != CACHESIM_OK)
+      return result;
+    save_context(&sim->ctx);
+    free_context(&sim->ctx);
+    current = NULL;
+  }
+  free(sim);
+  return CACHESIM_OK;
+}
+/************************************************************/
@@ -0,0 +1,67 @@
+/* Embeddable simulator, built as libcachesim.a. A handle holds one
+   complete simulated system, the private caches, their coherence and any
+   of the optional models around them: set its parameters, feed it
+   references, flush it at the end of the run and read its counters.
+
+     Pcachesim sim = cachesim_create();
+     cache_stat total;
+
+     cachesim_set(sim, NUM_CORE, 4);
+     cachesim_set(sim, PARAM_PROTOCOL, PROTO_MOESI);
+     for (...)
+       cachesim_access(sim, addr, DATA_LOAD_REFERENCE, pid);
+     cachesim_flush(sim);
+     cachesim_stats(sim, -1, &total);
+     cachesim_destroy(sim);
+
+   cachesim_access_batch() runs an array of trace records as one call,
+   prefetching the set metadata of later references while it works on
+   earlier ones; the results are those of one cachesim_access() per load
+   or store record, and records of any other type are skipped.
+
+   The model state is per thread, so handles driven by different threads
+   run concurrently without locking. A thread may drive several handles in
+   turn, but a handle stays with the thread that first accesses it, which
+   must also destroy it. Parameters take effect at the first access and
+   cannot change after it.
+
+   A handle takes every parameter of set_cache_param(), so it can hold the
+   lower levels, timing, classification, hot blocks, prefetchers and write
+   buffers as well as the private caches; cachesim_print_stats() reports
+   them as the sim binary does. The sim binary itself still drives the
+   model directly, for its sweeps, -j and checkpoints.
+
+   Every call but cachesim_create(), which returns NULL when out of
+   memory, returns CACHESIM_OK or one of the errors below and leaves the
+   handle as it was on error; cachesim_error() gives the message of the
+   last one. A handle whose parameters cannot be simulated together
+   builds nothing and fails every access with CACHESIM_BAD_CONFIG. Only
+   running out of memory while building a model still exits. */
+#include "cache.h"
+#include "trace.h"
+#include "protocol.h"
+#include "repl.h"
+
+#define MAX_SIM_PARAMS 64	/* cachesim_set calls per handle */
+
+/* results */
+#define CACHESIM_OK 0
+#define CACHESIM_UNSUPPORTED (-1)	/* a parameter cachesim_set() does not know */
+#define CACHESIM_BAD_VALUE (-2)		/* a value the parameter cannot take */
+#define CACHESIM_BUILT (-3)		/* a parameter set after the first access */
+#define CACHESIM_BAD_CONFIG (-4)	/* parameters that cannot be simulated together */
+#define CACHESIM_OTHER_THREAD (-5)	/* a handle built by another thread */
+#define CACHESIM_BAD_CORE (-6)		/* a core the handle does not simulate */
+
+typedef struct cachesim_ *Pcachesim;
+
+Pcachesim cachesim_create();
+int cachesim_set(Pcachesim sim, int param, int value);
+int cachesim_set_cores(Pcachesim sim, int first, int last, int usize, int assoc, int block_size);
+int cachesim_access(Pcachesim sim, unsigned long long addr, unsigned access_type, unsigned pid);
+int cachesim_access_batch(Pcachesim sim, trace_record *rec, int n);
+int cachesim_flush(Pcachesim sim);
+int cachesim_stats(Pcachesim sim, int pid, Pcache_stat st);
+int cachesim_print_stats(Pcachesim sim);
+const char *cachesim_error(Pcachesim sim);
+int cachesim_destroy(Pcachesim sim);
@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "classify.h"
+
+#define NO_NODE (-1)
+#define NO_BLOCK (~0ULL)
+
+/* Per thread, like the model of cache.c; see classify_save() */
+static __thread int num_core;
+static __thread int words;		/* words per block */
+static __thread unsigned long long now = 1;	/* references classified so far, plus one */
+
+/* Per core fully associative LRU shadow cache, as large as the core's own
+   cache. Nodes of core pid are base[pid] .. base[pid] + capacity[pid] - 1,
+   chained most recently used first, and found through an open addressing
+   table of hash_size slots per core. */
+static __thread int *capacity, *base, hash_size;
+static __thread unsigned long long *node_block;
+static __thread unsigned long long *node_inval;	/* reference that invalidated the copy, 0 if none */
+static __thread int *node_prev, *node_next;
+static __thread int *node_slot;		/* hash slot pointing at each node */
+static __thread int *head, *tail, *used;
+static __thread int *slots;		/* node of each hash slot, NO_NODE if free */
+
+/* Blocks referenced so far: which cores referenced them, when each word
+   was last written and how many false sharing misses they caused */
+static __thread unsigned long long *blocks;
+static __thread unsigned long long *seen;
+static __thread unsigned long long *written;
+static __thread int *false_shared;
+static __thread long n_blocks, block_mask, n_used;
+static __thread int seen_words;		/* 64 bit words per seen bitmap */
+
+#define HASH(block) ((unsigned)(((block) * 0x9E3779B97F4A7C15ULL) >> 32))
+
+/************************************************************/
+static void *alloc(size_t n, size_t size)
+{
+  void *p = calloc(n, size);
+
+  if (p == NULL) {
+    printf("error : Memory allocation failed for miss classification\n");
+    exit(-1);
+  }
+  return p;
+}
+
+static void alloc_blocks(long n)
+{
+  long i;
+
+  n_blocks = n;
+  block_mask = n - 1;
+  blocks = (unsigned long long *)alloc(n, sizeof(unsigned long long));
+  seen = (unsigned long long *)alloc((size_t)n * seen_words, sizeof(unsigned long long));
+  written = (unsigned long long *)alloc((size_t)n * words, sizeof(unsigned long long));
+  false_shared = (int *)alloc(n, sizeof(int));
+  for (i = 0; i < n; i++)
+    blocks[i] = NO_BLOCK;
+}
+
+/* lines_per_core gives the number of lines of each core's cache */
+void classify_init(int n_cores, int *lines_per_core, int block_size)
+{
+  int i, nodes = 0, largest = 0;
+
+  num_core = n_cores;
+  words = block_size / WORD_SIZE;
+  now = 1;
+  n_used = 0;
+  capacity = (int *)alloc(n_cores, sizeof(int));
+  base = (int *)alloc(n_cores, sizeof(int));
+  for (i = 0; i < n_cores; i++) {
+    capacity[i] = lines_per_core[i];
+    base[i] = nodes;
+    nodes += capacity[i];
+    if (capacity[i] > largest)
+      largest = capacity[i];
+  }
+  for (hash_size = 1; hash_size < 2 * largest; hash_size <<= 1)
+    ;
+
+  node_block = (unsigned long long *)alloc(nodes, sizeof(unsigned long long));
+  node_inval = (unsigned long long *)alloc(nodes, sizeof(unsigned long long));
+  node_prev = (int *)alloc(nodes, sizeof(int));
+  node_next = (int *)alloc(nodes, sizeof(int));
+  node_slot = (int *)alloc(nodes, sizeof(int));
+  head = (int *)alloc(n_cores, sizeof(int));
+  tail = (int *)alloc(n_cores, sizeof(int));
+  used = (int *)alloc(n_cores, sizeof(int));
+  slots = (int *)alloc((size_t)n_cores * hash_size, sizeof(int));
+  for (i = 0; i < n_cores; i++)
+    head[i] = tail[i] = NO_NODE;
+  for (i = 0; i < n_cores * hash_size; i++)
+    slots[i] = NO_NODE;
+
+  seen_words = (n_cores + 63) / 64;
+  alloc_blocks(1024);
+}
+/************************************************************/
+
+/************************************************************/
+/* Shadow cache of one core */
+
+static int shadow_find(unsigned long long block, unsigned pid)
+{
+  int *s = &slots[(size_t)pid * hash_size];
+  unsigned i;
+
+  for (i = HASH(block) & (hash_size - 1); s[i] != NO_NODE; i = (i + 1) & (hash_size - 1))
+    if (node_block[s[i]] == block)
+      return s[i];
+  return NO_NODE;
+}
+
+static void unlink_node(int node, unsigned pid)
+{
+  if (node_prev[node] == NO_NODE)
+    head[pid] = node_next[node];
+  else
+    node_next[node_prev[node]] = node_next[node];
+  if (node_next[node] == NO_NODE)
+    tail[pid] = node_prev[node];
+  else
+    node_prev[node_next[node]] = node_prev[node];
+}
+
+static void push_front(int node, unsigned pid)
+{
+  node_prev[node] = NO_NODE;
+  node_next[node] = head[pid];
+  if (head[pid] != NO_NODE)
+    node_prev[head[pid]] = node;
+  head[pid] = node;
+  if (tail[pid] == NO_NODE)
+    tail[pid] = node;
+}
+
+/* frees the hash slot of node, moving later entries of its probe run back */
+static void unhash(int node, unsigned pid)
+{
+  int *s = &slots[(size_t)pid * hash_size];
+  unsigned hole = node_slot[node], i, home;
+
+  s[hole] = NO_NODE;
+  for (i = (hole + 1) & (hash_size - 1); s[i] != NO_NODE; i = (i + 1) & (hash_size - 1)) {
+    home = HASH(node_block[s[i]]) & (hash_size - 1);
+    if (((i - home) & (hash_size - 1)) >= ((i - hole) & (hash_size - 1))) {
+      s[hole] = s[i];
+      node_slot[s[hole]] = hole;
+      s[i] = NO_NODE;
+      hole = i;
+    }
+  }
+}
+
+/* makes block the most recently used block of the shadow cache of pid,
+   returns TRUE if it was there */
+static int shadow_touch(unsigned long long block, unsigned pid)
+{
+  int *s = &slots[(size_t)pid * hash_size];
+  int node = shadow_find(block, pid);
+  unsigned i;
+
+  if (node != NO_NODE) {
+    unlink_node(node, pid);
+    push_front(node, pid);
+    node_inval[node] = 0;
+    return TRUE;
+  }
+
+  if (used[pid] < capacity[pid])
+    node = base[pid] + used[pid]++;
+  else {
+    node = tail[pid];
+    unlink_node(node, pid);
+    unhash(node, pid);
+  }
+  node_block[node] = block;
+  node_inval[node] = 0;
+  for (i = HASH(block) & (hash_size - 1); s[i] != NO_NODE; i = (i + 1) & (hash_size - 1))
+    ;
+  s[i] = node;
+  node_slot[node] = i;
+  push_front(node, pid);
+  return FALSE;
+}
+/************************************************************/
+
+/************************************************************/
+/* Referenced blocks */
+
+static long block_slot(unsigned long long block)
+{
+  unsigned long long *old_blocks, *old_seen, *old_written;
+  int *old_false;
+  long i, j, old_n;
+
+  for (i = HASH(block) & block_mask; blocks[i] != NO_BLOCK; i = (i + 1) & block_mask)
+    if (blocks[i] == block)
+      return i;
+
+  /* a new block, keep the table at most half full */
+  if (2 * (n_used + 1) > n_blocks) {
+    old_blocks = blocks;
+    old_seen = seen;
+    old_written = written;
+    old_false = false_shared;
+    old_n = n_blocks;
+    alloc_blocks(2 * n_blocks);
+    for (j = 0; j < old_n; j++) {
+      if (old_blocks[j] == NO_BLOCK)
+        continue;
+      for (i = HASH(old_blocks[j]) & block_mask; blocks[i] != NO_BLOCK; i = (i + 1) & block_mask)
+        ;
+      blocks[i] = old_blocks[j];
+      memcpy(&seen[(size_t)i * seen_words], &old_seen[(size_t)j * seen_words],
+             sizeof(unsigned long long) * seen_words);
+      memcpy(&written[(size_t)i * words], &old_written[(size_t)j * words],
+             sizeof(unsigned long long) * words);
+      false_shared[i] = old_false[j];
+    }
+    free(old_blocks);
+    free(old_seen);
+    free(old_written);
+    free(old_false);
+    for (i = HASH(block) & block_mask; blocks[i] != NO_BLOCK; i = (i + 1) & block_mask)
+      ;
+  }
+  blocks[i] = block;
+  n_used++;
+  return i;
+}
+/************************************************************/
+
+/************************************************************/
+/* counts the class of a miss by pid on word of block */
+void classify_miss(unsigned long long block, unsigned word, unsigned pid)
+{
+  Pcache_stat st = core_stats(pid);
+  long b = block_slot(block);
+  unsigned long long *bits = &seen[(size_t)b * seen_words + pid / 64];
+  int node = shadow_find(block, pid);
+
+  now++;
+  if (!(*bits & (1ULL << (pid % 64)))) {
+    *bits |= 1ULL << (pid % 64);
+    st->compulsory_misses++;
+  } else if (node != NO_NODE && node_inval[node]) {
+    if (written[(size_t)b * words + word] > node_inval[node])
+      st->true_sharing_misses++;
+    else {
+      st->false_sharing_misses++;
+      false_shared[b]++;
+    }
+  } else if (node != NO_NODE)
+    st->conflict_misses++;
+  else
+    st->capacity_misses++;
+  shadow_touch(block, pid);
+}
+
+void classify_hit(unsigned long long block, unsigned pid)
+{
+  now++;
+  shadow_touch(block, pid);
+}
+
+/* records a store to word of block by the reference being classified */
+void classify_write(unsigned long long block, unsigned word)
+{
+  long b = block_slot(block);	/* may grow the table, so before written */
+
+  written[(size_t)b * words + word] = now;
+}
+
+/* pid referenced block without the reference being classified: a sampled
+   run fast-forwarded it, or its prefetch took the compulsory miss */
+void classify_seen(unsigned long long block, unsigned pid)
+{
+  long b = block_slot(block);	/* may grow the table, so before seen */
+
+  seen[(size_t)b * seen_words + pid / 64] |= 1ULL << (pid % 64);
+}
+
+/* a remote write took the copy of pid away */
+void classify_invalidate(unsigned long long block, unsigned pid)
+{
+  int node = shadow_find(block, pid);
+
+  if (node != NO_NODE)
+    node_inval[node] = now;
+}
+/************************************************************/
+
+/************************************************************/
+void print_classify_stats(int block_bits)
+{
+  int i, j, k, n_top = 0;
+  long b, top[N_FALSE_SHARED];
+  Pcache_stat st;
+  cache_stat t;
+
+  memset(&t, 0, sizeof(t));
+  printf("\n");
+  printf("  MISS CLASSES\n");
+  for (i = 0; i < num_core; i++) {
+    st = core_stats(i);
+    printf("  CORE %d: compulsory %lld, capacity %lld, conflict %lld, true sharing %lld, false sharing %lld\n",
+           i, st->compulsory_misses, st->capacity_misses, st->conflict_misses,
+           st->true_sharing_misses, st->false_sharing_misses);
+    t.compulsory_misses += st->compulsory_misses;
+    t.capacity_misses += st->capacity_misses;
+    t.conflict_misses += st->conflict_misses;
+    t.true_sharing_misses += st->true_sharing_misses;
+    t.false_sharing_misses += st->false_sharing_misses;
+  }
+  printf("  compulsory:           %lld\n", t.compulsory_misses);
+  printf("  capacity:             %lld\n", t.capacity_misses);
+  printf("  conflict:             %lld\n", t.conflict_misses);
+  printf("  true sharing:         %lld\n", t.true_sharing_misses);
+  printf("  false sharing:        %lld\n", t.false_sharing_misses);
+
+  /* the blocks with the most false sharing misses, most first */
+  for (b = 0; b < n_blocks; b++) {
+    if (blocks[b] == NO_BLOCK || !false_shared[b])
+      continue;
+    for (k = n_top; k > 0 && false_shared[top[k-1]] < false_shared[b]; k--)
+      ;
+    if (k == N_FALSE_SHARED)
+      continue;
+    if (n_top < N_FALSE_SHARED)
+      n_top++;
+    for (j = n_top - 1; j > k; j--)
+      top[j] = top[j-1];
+    top[k] = b;
+  }
+  if (n_top)
+    printf("  falsely shared blocks (misses):\n");
+  for (k = 0; k < n_top; k++)
+    printf("    0x%llx %d\n", blocks[top[k]] << block_bits, false_shared[top[k]]);
+}
+/************************************************************/
+
+/************************************************************/
+/* copies the classifier of this thread into ctx, classify_load() puts it
+   back */
+void classify_save(classify_context *ctx)
+{
+  ctx->num_core = num_core;
+  ctx->words = words;
+  ctx->now = now;
+  ctx->capacity = capacity;
+  ctx->base = base;
+  ctx->hash_size = hash_size;
+  ctx->node_block = node_block;
+  ctx->node_inval = node_inval;
+  ctx->node_prev = node_prev;
+  ctx->node_next = node_next;
+  ctx->node_slot = node_slot;
+  ctx->head = head;
+  ctx->tail = tail;
+  ctx->used = used;
+  ctx->slots = slots;
+  ctx->blocks = blocks;
+  ctx->seen = seen;
+  ctx->written = written;
+  ctx->false_shared = false_shared;
+  ctx->n_blocks = n_blocks;
+  ctx->block_mask = block_mask;
+  ctx->n_used = n_used;
+  ctx->seen_words = seen_words;
+}
+
+void classify_load(classify_context *ctx)
+{
+  num_core = ctx->num_core;
+  words = ctx->words;
+  now = ctx->now;
+  capacity = ctx->capacity;
+  base = ctx->base;
+  hash_size = ctx->hash_size;
+  node_block = ctx->node_block;
+  node_inval = ctx->node_inval;
+  node_prev = ctx->node_prev;
+  node_next = ctx->node_next;
+  node_slot = ctx->node_slot;
+  head = ctx->head;
+  tail = ctx->tail;
+  used = ctx->used;
+  slots = ctx->slots;
+  blocks = ctx->blocks;
+  seen = ctx->seen;
+  written = ctx->written;
+  false_shared = ctx->false_shared;
+  n_blocks = ctx->n_blocks;
+  block_mask = ctx->block_mask;
+  n_used = ctx->n_used;
+  seen_words = ctx->seen_words;
+}
+
+void classify_free(classify_context *ctx)
+{
+  free(ctx->capacity);
+  free(ctx->base);
+  free(ctx->node_block);
+  free(ctx->node_inval);
+  free(ctx->node_prev);
+  free(ctx->node_next);
+  free(ctx->node_slot);
+  free(ctx->head);
+  free(ctx->tail);
+  free(ctx->used);
+  free(ctx->slots);
+  free(ctx->blocks);
+  free(ctx->seen);
+  free(ctx->written);
+  free(ctx->false_shared);
+}
+/************************************************************/
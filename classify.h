@@ -0,0 +1,34 @@
+/* Optional miss classification. Every miss is compulsory, capacity,
+   conflict or coherence, judged against a fully associative LRU cache of
+   the same capacity per core: a block the core never referenced is
+   compulsory, one the shadow cache would still hold but for a remote
+   invalidation is coherence, one the shadow cache also misses is capacity
+   and the rest are conflict. A coherence miss is true sharing if another
+   core wrote the word it references since the invalidation, otherwise
+   false sharing. */
+#define N_FALSE_SHARED 8	/* blocks listed by print_classify_stats() */
+
+/* the classifier of one cache_context, see save_context() */
+typedef struct classify_context_ {
+  int num_core, words;
+  unsigned long long now;
+  int *capacity, *base, hash_size;
+  unsigned long long *node_block, *node_inval;
+  int *node_prev, *node_next, *node_slot;
+  int *head, *tail, *used, *slots;
+  unsigned long long *blocks, *seen, *written;
+  int *false_shared;
+  long n_blocks, block_mask, n_used;
+  int seen_words;
+} classify_context;
+
+void classify_init(int n_cores, int *lines_per_core, int block_size);
+void classify_miss(unsigned long long block, unsigned word, unsigned pid);
+void classify_hit(unsigned long long block, unsigned pid);
+void classify_write(unsigned long long block, unsigned word);
+void classify_invalidate(unsigned long long block, unsigned pid);
+void classify_seen(unsigned long long block, unsigned pid);
+void print_classify_stats(int block_bits);
+void classify_save(classify_context *ctx);
+void classify_load(classify_context *ctx);
+void classify_free(classify_context *ctx);
@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "cache.h"
+#include "hier.h"
+
+static char *policy_names[] = { "inclusive", "exclusive", "non-inclusive" };
+
+/* Per thread, like the model of cache.c; see hier_save() */
+static __thread Pcache l2;		/* private L2 of each core, NULL if none */
+static __thread Pcache llc;		/* shared last-level cache, NULL if none */
+static __thread int llc_policy = DEFAULT_LLC_POLICY;
+static __thread int words;		/* words per block */
+static __thread int num_core;
+
+static __thread char error_text[160];
+
+/************************************************************/
+/* returns why a lower level cache cannot be built, NULL if it can */
+static char *level_error(char *name, int size, int assoc, int block_size)
+{
+  int n_sets;
+
+  if (assoc < 1 || assoc > 255) {
+    snprintf(error_text, sizeof(error_text), "%s associativity must be between 1 and 255", name);
+    return error_text;
+  }
+  n_sets = size / block_size / assoc;
+  if (n_sets < 1 || (n_sets & (n_sets - 1))) {
+    snprintf(error_text, sizeof(error_text),
+             "%s of %d bytes does not split into a power of two number of %d-way sets",
+             name, size, assoc);
+    return error_text;
+  }
+  return NULL;
+}
+
+/* returns why the levels cannot be built, NULL if they can */
+char *hier_error(int l2_size, int l2_assoc, int llc_size, int llc_assoc, int block_size)
+{
+  char *msg = NULL;
+
+  if (l2_size)
+    msg = level_error("L2", l2_size, l2_assoc, block_size);
+  if (msg == NULL && llc_size)
+    msg = level_error("LLC", llc_size, llc_assoc, block_size);
+  return msg;
+}
+
+/* sizes one lower level cache for block numbers rather than addresses */
+static void init_level(Pcache c, char *name, int size, int assoc, int block_size)
+{
+  int n_sets, n_lines, j;
+  char *msg = level_error(name, size, assoc, block_size);
+
+  if (msg != NULL) {
+    printf("error : %s\n", msg);
+    exit(-1);
+  }
+  n_sets = size / block_size / assoc;
+  c->size = size;
+  c->associativity = assoc;
+  c->n_sets = n_sets;
+  c->index_mask = n_sets - 1;
+  c->index_mask_offset = 0;
+  c->tag_shift = LOG2(n_sets);
+
+  n_lines = n_sets * assoc;
+  c->tags = (unsigned long long *)malloc(sizeof(unsigned long long) * n_lines);
+  c->states = (unsigned char *)calloc(n_lines, sizeof(unsigned char));
+  c->ranks = (unsigned char *)malloc(sizeof(unsigned char) * n_lines);
+  c->set_contents = (int *)calloc(n_sets, sizeof(int));
+  if (c->tags == NULL || c->states == NULL || c->ranks == NULL || c->set_contents == NULL) {
+    printf("error : Memory allocation failed for the %s\n", name);
+    exit(-1);
+  }
+  for (j = 0; j < n_lines; j++) {
+    c->tags[j] = EMPTY_TAG;
+    c->ranks[j] = EMPTY_RANK;
+  }
+}
+
+void hier_init(int l2_size, int l2_assoc, int llc_size, int llc_assoc,
+               int policy, int block_size, int n_cores)
+{
+  int i;
+
+  words = block_size / WORD_SIZE;
+  num_core = n_cores;
+  llc_policy = policy;
+  l2 = llc = NULL;
+
+  if (l2_size) {
+    l2 = (Pcache)calloc(n_cores, sizeof(cache));
+    if (l2 == NULL) {
+      printf("error : Memory allocation failed for the L2 caches\n");
+      exit(-1);
+    }
+    for (i = 0; i < n_cores; i++) {
+      l2[i].id = i;
+      init_level(&l2[i], "L2", l2_size, l2_assoc, block_size);
+    }
+  }
+  if (llc_size) {
+    llc = (Pcache)calloc(1, sizeof(cache));
+    if (llc == NULL) {
+      printf("error : Memory allocation failed for the LLC\n");
+      exit(-1);
+    }
+    init_level(llc, "LLC", llc_size, llc_assoc, block_size);
+  }
+}
+/************************************************************/
+
+/************************************************************/
+#define LEVEL_INDEX(c, block) ((unsigned)((block) & (c)->index_mask))
+#define LEVEL_TAG(c, block) ((block) >> (c)->tag_shift)
+
+/* returns the line holding a valid copy of block, -1 if there is none */
+static int level_find(Pcache c, unsigned long long block)
+{
+  int line;
+
+  if (search(c, LEVEL_INDEX(c, block), LEVEL_TAG(c, block), &line) != TAG_HIT_VALID)
+    return -1;
+  return line;
+}
+
+/* Installs block as the most recently used line of its set, reusing an
+   invalidated way before evicting the least recently used one. Returns
+   the state of the displaced copy, INVALID_STATE if there was none. */
+static int level_fill(Pcache c, unsigned long long block, int state,
+                      unsigned long long *victim)
+{
+  unsigned index = LEVEL_INDEX(c, block);
+  unsigned long long tag = LEVEL_TAG(c, block);
+  int line, way, old = INVALID_STATE;
+
+  if (search(c, index, tag, &line) == TAG_MISS) {
+    line = -1;
+    if (c->set_contents[index] == c->associativity)
+      for (way = 0; way < c->associativity; way++)
+        if (c->states[index * c->associativity + way] == INVALID_STATE) {
+          line = index * c->associativity + way;
+          break;
+        }
+    if (line < 0) {
+      if (c->set_contents[index] == c->associativity) {
+        line = lru_victim(c, index);
+        old = c->states[line];
+        *victim = (c->tags[line] << c->tag_shift) | index;
+      }
+      line = insert(c, index, tag);
+    } else {
+      c->tags[line] = tag;
+      touch(c, index, line);
+    }
+  } else
+    touch(c, index, line);
+
+  c->states[line] = state;
+  return old;
+}
+/************************************************************/
+
+/************************************************************/
+/* TRUE if any private cache, L1 or L2, still holds block */
+static int held_privately(unsigned long long block)
+{
+  int i;
+
+  if (held_in_l1(block))
+    return TRUE;
+  if (l2)
+    for (i = 0; i < num_core; i++)
+      if (level_find(&l2[i], block) >= 0)
+        return TRUE;
+  return FALSE;
+}
+
+/* fills the LLC, back-invalidating the private copies of an inclusive
+   victim and writing dirty victims to DRAM */
+static void llc_fill(unsigned long long block, int state, Pcache_stat st)
+{
+  unsigned long long victim;
+  int old, i, line, dirty = FALSE;
+
+  old = level_fill(llc, block, state, &victim);
+  if (old == INVALID_STATE)
+    return;
+  dirty = old == LINE_DIRTY;
+
+  if (llc_policy == LLC_INCLUSIVE) {
+    st->back_invalidations += back_invalidate(victim, &dirty);
+    if (l2)
+      for (i = 0; i < num_core; i++)
+        if ((line = level_find(&l2[i], victim)) >= 0) {
+          dirty |= l2[i].states[line] == LINE_DIRTY;
+          l2[i].states[line] = INVALID_STATE;
+          st->back_invalidations++;
+        }
+  }
+  if (dirty)
+    st->dram_copies_back += words;
+}
+
+/* An inclusive LLC evicted a block while a private copy of it was on its
+   way down, after the back-invalidation could find it. The copy is dropped
+   as the back-invalidation would have done. */
+static void back_invalidated(int dirty, Pcache_stat st)
+{
+  st->back_invalidations++;
+  if (dirty)
+    st->dram_copies_back += words;
+}
+
+/* a copy of block leaves the private levels of a core, or is written
+   back from them */
+static void llc_put(unsigned long long block, int dirty, Pcache_stat st)
+{
+  int line;
+
+  if (llc == NULL) {
+    if (dirty)
+      st->dram_copies_back += words;
+    return;
+  }
+
+  /* An exclusive LLC drops a clean copy that another private cache still
+     holds, but takes a dirty one in rather than send it to DRAM; the block
+     leaves the LLC again with the next fetch. */
+  if (llc_policy == LLC_EXCLUSIVE) {
+    if ((line = level_find(llc, block)) >= 0) {
+      if (dirty)
+        llc->states[line] = LINE_DIRTY;
+    } else if (dirty || !held_privately(block))
+      llc_fill(block, dirty ? LINE_DIRTY : LINE_CLEAN, st);
+    return;
+  }
+
+  if ((line = level_find(llc, block)) >= 0) {
+    if (dirty)
+      llc->states[line] = LINE_DIRTY;
+  } else if (llc_policy == LLC_INCLUSIVE)
+    back_invalidated(dirty, st);
+  else if (dirty)
+    llc_fill(block, LINE_DIRTY, st);
+}
+
+/* Installs block in the L2 of pid, passing its victim down. A block moving
+   between the private levels may meet an LLC that changed meanwhile: an
+   exclusive LLC gives up the copy it took in, an inclusive one that
+   dropped the block keeps the L2 from taking it. */
+static void l2_fill(unsigned long long block, unsigned pid, int state, Pcache_stat st)
+{
+  unsigned long long victim;
+  int old, line;
+
+  if (llc && llc_policy == LLC_EXCLUSIVE && (line = level_find(llc, block)) >= 0) {
+    if (llc->states[line] == LINE_DIRTY)
+      state = LINE_DIRTY;
+    llc->states[line] = INVALID_STATE;
+  }
+  if (llc && llc_policy == LLC_INCLUSIVE && level_find(llc, block) < 0) {
+    back_invalidated(state == LINE_DIRTY, st);
+    return;
+  }
+  old = level_fill(&l2[pid], block, state, &victim);
+  if (old != INVALID_STATE)
+    llc_put(victim, old == LINE_DIRTY, st);
+}
+/************************************************************/
+
+/************************************************************/
+/* Serves a private cache miss that no other core supplied and returns the
+   FILL_ level that had the block. state is the coherence state the block
+   is filled in; a dirty block moved up out of an exclusive LLC with no L2
+   to hold it makes an EXCLUSIVE fill MODIFIED. */
+int hier_fetch(unsigned long long block, unsigned pid, unsigned char *state)
+{
+  Pcache_stat st = core_stats(pid);
+  int line, fill = LINE_CLEAN, source = FILL_LLC;
+
+  if (l2) {
+    st->l2_accesses++;
+    if ((line = level_find(&l2[pid], block)) >= 0) {
+      touch(&l2[pid], LEVEL_INDEX(&l2[pid], block), line);
+      return FILL_L2;
+    }
+    st->l2_misses++;
+  }
+
+  if (llc) {
+    st->llc_accesses++;
+    if ((line = level_find(llc, block)) >= 0) {
+      if (llc_policy == LLC_EXCLUSIVE) {
+        if (llc->states[line] == LINE_DIRTY)
+          fill = LINE_DIRTY;
+        llc->states[line] = INVALID_STATE;
+      } else
+        touch(llc, LEVEL_INDEX(llc, block), line);
+    } else {
+      st->llc_misses++;
+      st->dram_fetches += words;
+      source = FILL_DRAM;
+      if (llc_policy != LLC_EXCLUSIVE)
+        llc_fill(block, LINE_CLEAN, st);
+    }
+  } else {
+    st->dram_fetches += words;
+    source = FILL_DRAM;
+  }
+
+  if (l2)
+    l2_fill(block, pid, fill, st);
+  else if (fill == LINE_DIRTY) {
+    if (*state == EXCLUSIVE_STATE)
+      *state = MODIFIED_STATE;
+    else if (*state != MODIFIED_STATE && *state != OWNED_STATE)
+      st->dram_copies_back += words;
+  }
+  return source;
+}
+
+/* a private cache of pid evicts its copy of block */
+void hier_evict(unsigned long long block, unsigned pid, int dirty)
+{
+  Pcache_stat st = core_stats(pid);
+  int line;
+
+  if (l2 == NULL) {
+    llc_put(block, dirty, st);
+    return;
+  }
+  if ((line = level_find(&l2[pid], block)) >= 0) {
+    if (dirty)
+      l2[pid].states[line] = LINE_DIRTY;
+  } else
+    l2_fill(block, pid, dirty ? LINE_DIRTY : LINE_CLEAN, st);
+}
+
+/* the private cache of pid writes block back but keeps a clean copy */
+void hier_write_back(unsigned long long block, unsigned pid)
+{
+  hier_evict(block, pid, TRUE);
+}
+
+/* Keeps the L2s coherent with the private caches: a write by pid drops
+   every other L2 copy, the writer now owns the data; a read makes a dirty
+   L2 copy write itself back so the reader sees the latest data. An
+   exclusive LLC cannot take that copy while the L2 still holds it, so
+   there a peer L2 copy answers a miss on chip instead, keeping its state
+   on a read. Returns TRUE if a peer L2 supplied the block. */
+int hier_snoop(unsigned long long block, unsigned pid, unsigned broadcast_type)
+{
+  int i, line, supplied = FALSE;
+
+  if (l2 == NULL)
+    return FALSE;
+  for (i = 0; i < num_core; i++) {
+    if (i == (int)pid || (line = level_find(&l2[i], block)) < 0)
+      continue;
+    if (llc_policy == LLC_EXCLUSIVE && broadcast_type != REMOTE_WRITE_HIT)
+      supplied = TRUE;
+    if (broadcast_type != REMOTE_READ_MISS)
+      l2[i].states[line] = INVALID_STATE;
+    else if (l2[i].states[line] == LINE_DIRTY && llc_policy != LLC_EXCLUSIVE) {
+      l2[i].states[line] = LINE_CLEAN;
+      llc_put(block, TRUE, core_stats(i));
+    }
+  }
+  return supplied;
+}
+/************************************************************/
+
+/************************************************************/
+/* End of run: dirty data is written down level by level, so a block dirty
+   in several levels reaches DRAM once. Shared LLC lines are charged to
+   core 0. */
+void hier_flush_line(unsigned long long block, unsigned pid)
+{
+  int line;
+
+  if (l2 && (line = level_find(&l2[pid], block)) >= 0)
+    l2[pid].states[line] = LINE_DIRTY;
+  else if (llc && (line = level_find(llc, block)) >= 0)
+    llc->states[line] = LINE_DIRTY;
+  else
+    core_stats(pid)->dram_copies_back += words;
+}
+
+void hier_flush()
+{
+  int i, j, line;
+  unsigned long long block;
+
+  if (l2)
+    for (i = 0; i < num_core; i++)
+      for (j = 0; j < l2[i].n_sets * l2[i].associativity; j++)
+        if (l2[i].states[j] == LINE_DIRTY) {
+          block = (l2[i].tags[j] << l2[i].tag_shift) | (j / l2[i].associativity);
+          if (llc && (line = level_find(llc, block)) >= 0)
+            llc->states[line] = LINE_DIRTY;
+          else
+            core_stats(i)->dram_copies_back += words;
+        }
+  if (llc)
+    for (j = 0; j < llc->n_sets * llc->associativity; j++)
+      if (llc->states[j] == LINE_DIRTY)
+        core_stats(0)->dram_copies_back += words;
+}
+/************************************************************/
+
+/************************************************************/
+int hier_has_l2()
+{
+  return l2 != NULL;
+}
+
+char *llc_policy_name()
+{
+  return policy_names[llc_policy];
+}
+
+/* returns the LLC_ policy for a name, -1 if unknown */
+int find_llc_policy(char *name)
+{
+  int p;
+
+  for (p = 0; p < 3; p++)
+    if (!strcasecmp(name, policy_names[p]))
+      return p;
+  if (!strcasecmp(name, "nine"))
+    return LLC_NINE;
+  return -1;
+}
+/************************************************************/
+
+/************************************************************/
+/* copies the levels of this thread into ctx, hier_load() puts them back */
+void hier_save(hier_context *ctx)
+{
+  ctx->l2 = l2;
+  ctx->llc = llc;
+  ctx->llc_policy = llc_policy;
+  ctx->words = words;
+  ctx->num_core = num_core;
+}
+
+void hier_load(hier_context *ctx)
+{
+  l2 = ctx->l2;
+  llc = ctx->llc;
+  llc_policy = ctx->llc_policy;
+  words = ctx->words;
+  num_core = ctx->num_core;
+}
+
+static void free_level(Pcache c)
+{
+  free(c->tags);
+  free(c->states);
+  free(c->ranks);
+  free(c->set_contents);
+}
+
+void hier_free(hier_context *ctx)
+{
+  int i;
+
+  if (ctx->l2 != NULL) {
+    for (i = 0; i < ctx->num_core; i++)
+      free_level(&ctx->l2[i]);
+    free(ctx->l2);
+  }
+  if (ctx->llc != NULL) {
+    free_level(ctx->llc);
+    free(ctx->llc);
+  }
+}
+/************************************************************/
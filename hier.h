@@ -0,0 +1,37 @@
+/* Memory hierarchy below the coherent private caches: an optional private
+   L2 per core and an optional shared last-level cache, both indexed by
+   block address. Coherence is kept by the private caches of cache.c; the
+   levels below only track whether their copy is clean or dirty and count
+   where each fetch and write back is served. */
+#define LLC_INCLUSIVE 0		/* holds every privately cached block */
+#define LLC_EXCLUSIVE 1		/* holds only blocks no private cache holds */
+#define LLC_NINE 2		/* neither inclusive nor exclusive */
+#define DEFAULT_LLC_POLICY LLC_INCLUSIVE
+
+/* lower level lines are only clean or dirty */
+#define LINE_CLEAN EXCLUSIVE_STATE
+#define LINE_DIRTY MODIFIED_STATE
+
+/* the levels of one cache_context, see save_context() */
+typedef struct hier_context_ {
+  Pcache l2, llc;
+  int llc_policy;
+  int words;
+  int num_core;
+} hier_context;
+
+char *hier_error(int l2_size, int l2_assoc, int llc_size, int llc_assoc, int block_size);
+void hier_init(int l2_size, int l2_assoc, int llc_size, int llc_assoc,
+               int llc_policy, int block_size, int n_cores);
+int hier_fetch(unsigned long long block, unsigned pid, unsigned char *state);
+void hier_evict(unsigned long long block, unsigned pid, int dirty);
+void hier_write_back(unsigned long long block, unsigned pid);
+int hier_snoop(unsigned long long block, unsigned pid, unsigned broadcast_type);
+void hier_flush_line(unsigned long long block, unsigned pid);
+void hier_flush();
+int hier_has_l2();
+char *llc_policy_name();
+int find_llc_policy(char *name);
+void hier_save(hier_context *ctx);
+void hier_load(hier_context *ctx);
+void hier_free(hier_context *ctx);
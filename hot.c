@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "hot.h"
+
+#define NO_ENTRY (-1)
+
+/* Per thread, like the model of cache.c; see hot_save() */
+static __thread int top_k, n_counters, hash_size;
+static __thread int sharer_words;	/* 64 bit words per sharer bitmap */
+static __thread int block_bits;
+static __thread int n_used;
+
+/* counters, heap ordered on count with the smallest at heap[0] */
+static __thread unsigned long long *blocks;
+static __thread long long *counts;
+static __thread long long *errors;	/* count inherited from the block replaced */
+static __thread long long *events;	/* N_HOT_EVENTS per counter */
+static __thread unsigned long long *sharers;	/* cores involved, sharer_words per counter */
+static __thread int *heap, *heap_pos;
+static __thread int *slots;		/* counter of each hash slot, NO_ENTRY if free */
+static __thread int *slot_of;
+
+#define HASH(block) ((unsigned)(((block) * 0x9E3779B97F4A7C15ULL) >> 32) & (hash_size - 1))
+
+/************************************************************/
+void hot_init(int k, int n_cores, int bits)
+{
+  int i;
+
+  top_k = k;
+  n_counters = k * HOT_COUNTERS_PER_K;
+  for (hash_size = 1; hash_size < 2 * n_counters; hash_size <<= 1)
+    ;
+  sharer_words = (n_cores + 63) / 64;
+  block_bits = bits;
+  n_used = 0;
+
+  blocks = (unsigned long long *)calloc(n_counters, sizeof(unsigned long long));
+  counts = (long long *)calloc(n_counters, sizeof(long long));
+  errors = (long long *)calloc(n_counters, sizeof(long long));
+  events = (long long *)calloc((size_t)n_counters * N_HOT_EVENTS, sizeof(long long));
+  sharers = (unsigned long long *)calloc((size_t)n_counters * sharer_words, sizeof(unsigned long long));
+  heap = (int *)calloc(n_counters, sizeof(int));
+  heap_pos = (int *)calloc(n_counters, sizeof(int));
+  slot_of = (int *)calloc(n_counters, sizeof(int));
+  slots = (int *)calloc(hash_size, sizeof(int));
+  if (blocks == NULL || counts == NULL || errors == NULL || events == NULL || sharers == NULL ||
+      heap == NULL || heap_pos == NULL || slot_of == NULL || slots == NULL) {
+    printf("error : Memory allocation failed for the hot block counters\n");
+    exit(-1);
+  }
+  for (i = 0; i < hash_size; i++)
+    slots[i] = NO_ENTRY;
+}
+/************************************************************/
+
+/************************************************************/
+/* restores the heap order below counter e after its count grew */
+static void sift_down(int e)
+{
+  int pos = heap_pos[e], child;
+
+  for (;;) {
+    child = 2 * pos + 1;
+    if (child >= n_used)
+      break;
+    if (child + 1 < n_used && counts[heap[child + 1]] < counts[heap[child]])
+      child++;
+    if (counts[heap[child]] >= counts[e])
+      break;
+    heap[pos] = heap[child];
+    heap_pos[heap[pos]] = pos;
+    pos = child;
+  }
+  heap[pos] = e;
+  heap_pos[e] = pos;
+}
+
+/* frees the hash slot of counter e, moving later entries of its probe
+   run back */
+static void unhash(int e)
+{
+  unsigned hole = slot_of[e], i, home;
+
+  slots[hole] = NO_ENTRY;
+  for (i = (hole + 1) & (hash_size - 1); slots[i] != NO_ENTRY; i = (i + 1) & (hash_size - 1)) {
+    home = HASH(blocks[slots[i]]);
+    if (((i - home) & (hash_size - 1)) >= ((i - hole) & (hash_size - 1))) {
+      slots[hole] = slots[i];
+      slot_of[slots[hole]] = hole;
+      slots[i] = NO_ENTRY;
+      hole = i;
+    }
+  }
+}
+
+/* counts one event of type on block, involving core pid */
+void hot_event(unsigned long long block, unsigned pid, int type)
+{
+  unsigned i;
+  int e, w;
+
+  for (i = HASH(block); slots[i] != NO_ENTRY; i = (i + 1) & (hash_size - 1))
+    if (blocks[slots[i]] == block)
+      break;
+  e = slots[i];
+
+  if (e == NO_ENTRY) {
+    if (n_used < n_counters) {
+      e = n_used++;
+      heap[n_used - 1] = e;
+      heap_pos[e] = n_used - 1;
+      counts[e] = 0;
+    } else {
+      //Take over the smallest counter
+      e = heap[0];
+      unhash(e);
+      for (i = HASH(block); slots[i] != NO_ENTRY; i = (i + 1) & (hash_size - 1))
+        ;
+    }
+    blocks[e] = block;
+    errors[e] = counts[e];
+    for (w = 0; w < N_HOT_EVENTS; w++)
+      events[(size_t)e * N_HOT_EVENTS + w] = 0;
+    for (w = 0; w < sharer_words; w++)
+      sharers[(size_t)e * sharer_words + w] = 0;
+    slots[i] = e;
+    slot_of[e] = i;
+  }
+
+  counts[e]++;
+  events[(size_t)e * N_HOT_EVENTS + type]++;
+  sharers[(size_t)e * sharer_words + pid / 64] |= 1ULL << (pid % 64);
+  sift_down(e);
+}
+/************************************************************/
+
+/************************************************************/
+void print_hot_stats()
+{
+  int i, j, k, w, n_top = 0, n_sharers, n_vague = 0;
+  int *top;
+
+  top = (int *)malloc(sizeof(int) * top_k);
+  if (top == NULL) {
+    printf("error : Memory allocation failed for the hot block report\n");
+    exit(-1);
+  }
+
+  /* the top_k counters with the largest guaranteed count, largest first,
+     leaving out those whose count is mostly inherited error */
+  for (i = 0; i < n_used; i++) {
+    if (errors[i] > counts[i] - errors[i]) {
+      n_vague++;
+      continue;
+    }
+    for (k = n_top; k > 0 && counts[top[k-1]] - errors[top[k-1]] < counts[i] - errors[i]; k--)
+      ;
+    if (k == top_k)
+      continue;
+    if (n_top < top_k)
+      n_top++;
+    for (j = n_top - 1; j > k; j--)
+      top[j] = top[j-1];
+    top[k] = i;
+  }
+
+  printf("\n");
+  printf("  HOT BLOCKS (at least events - error events each)\n");
+  printf("  %-18s %12s %12s %12s %12s %12s %7s\n", "address", "events", "error",
+         "invalidate", "transfer", "write back", "cores");
+  for (k = 0; k < n_top; k++) {
+    i = top[k];
+    for (n_sharers = 0, w = 0; w < sharer_words; w++)
+      n_sharers += __builtin_popcountll(sharers[(size_t)i * sharer_words + w]);
+    printf("  0x%-16llx %12lld %12lld %12lld %12lld %12lld %7d\n", blocks[i] << block_bits,
+           counts[i], errors[i], events[(size_t)i * N_HOT_EVENTS + HOT_INVALIDATION],
+           events[(size_t)i * N_HOT_EVENTS + HOT_TRANSFER],
+           events[(size_t)i * N_HOT_EVENTS + HOT_WRITE_BACK], n_sharers);
+  }
+  if (n_vague)
+    printf("  (%d tracked blocks left out, their error exceeds their certain events)\n", n_vague);
+  free(top);
+}
+/************************************************************/
+
+/************************************************************/
+/* copies the counters of this thread into ctx, hot_load() puts them
+   back */
+void hot_save(hot_context *ctx)
+{
+  ctx->top_k = top_k;
+  ctx->n_counters = n_counters;
+  ctx->hash_size = hash_size;
+  ctx->sharer_words = sharer_words;
+  ctx->block_bits = block_bits;
+  ctx->n_used = n_used;
+  ctx->blocks = blocks;
+  ctx->counts = counts;
+  ctx->errors = errors;
+  ctx->events = events;
+  ctx->sharers = sharers;
+  ctx->heap = heap;
+  ctx->heap_pos = heap_pos;
+  ctx->slots = slots;
+  ctx->slot_of = slot_of;
+}
+
+void hot_load(hot_context *ctx)
+{
+  top_k = ctx->top_k;
+  n_counters = ctx->n_counters;
+  hash_size = ctx->hash_size;
+  sharer_words = ctx->sharer_words;
+  block_bits = ctx->block_bits;
+  n_used = ctx->n_used;
+  blocks = ctx->blocks;
+  counts = ctx->counts;
+  errors = ctx->errors;
+  events = ctx->events;
+  sharers = ctx->sharers;
+  heap = ctx->heap;
+  heap_pos = ctx->heap_pos;
+  slots = ctx->slots;
+  slot_of = ctx->slot_of;
+}
+
+void hot_free(hot_context *ctx)
+{
+  free(ctx->blocks);
+  free(ctx->counts);
+  free(ctx->errors);
+  free(ctx->events);
+  free(ctx->sharers);
+  free(ctx->heap);
+  free(ctx->heap_pos);
+  free(ctx->slots);
+  free(ctx->slot_of);
+}
+/************************************************************/
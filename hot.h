@@ -0,0 +1,30 @@
+/* Optional hot block report. Invalidations, cache to cache transfers and
+   write backs are counted per block with the space-saving algorithm: a
+   fixed number of counters track the blocks seen most often, and a block
+   that is not tracked takes over the smallest counter, inheriting its
+   count as a possible overestimate. Memory stays bounded however long
+   the trace is, and any block with more events than the smallest counter
+   is guaranteed to be tracked. */
+#define HOT_INVALIDATION 0	/* a remote copy was invalidated */
+#define HOT_TRANSFER 1		/* a remote copy supplied the block */
+#define HOT_WRITE_BACK 2	/* the block was written back */
+#define N_HOT_EVENTS 3
+
+#define HOT_COUNTERS_PER_K 32	/* counters kept for each block reported */
+
+/* the counters of one cache_context, see save_context() */
+typedef struct hot_context_ {
+  int top_k, n_counters, hash_size;
+  int sharer_words, block_bits, n_used;
+  unsigned long long *blocks;
+  long long *counts, *errors, *events;
+  unsigned long long *sharers;
+  int *heap, *heap_pos, *slots, *slot_of;
+} hot_context;
+
+void hot_init(int k, int n_cores, int block_bits);
+void hot_event(unsigned long long block, unsigned pid, int type);
+void print_hot_stats();
+void hot_save(hot_context *ctx);
+void hot_load(hot_context *ctx);
+void hot_free(hot_context *ctx);
@@ -1,19 +1,131 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include "cache.h"
 #include "main.h"
+#include "trace.h"
+#include "shard.h"
+#include "pipeline.h"
+#include "prof.h"
+#include "sample.h"
+#include "protocol.h"
+#include "hier.h"
+#include "timing.h"
+#include "hot.h"
+#include "stats.h"
+#include "repl.h"
+#include "prefetch.h"
 
 static FILE *traceFile;
 
+/* sweep mode: every combination of the listed sizes, associativities,
+   block sizes and replacement policies is simulated side by side in a
+   single pass over the trace */
+static int sweep_usize[MAX_SWEEP], sweep_assoc[MAX_SWEEP], sweep_bsize[MAX_SWEEP];
+static int sweep_repl[MAX_SWEEP];
+static int n_usize, n_assoc, n_bsize, n_repl;
+#define SWEEP_SIZE (n_usize * n_assoc * n_bsize * n_repl)
+static Pcache_context configs;
+static int n_configs = 1;
+static int debug_flag = FALSE;
+static int n_threads = 1;
+static int n_parsers = 0;
+static int bench = FALSE;
+static int batched = TRUE;		/* -nobatch replays one reference at a time */
+
+/* checkpoints are written once the listed reference counts are reached;
+   text traces note the file offset of each boundary as it is decoded */
+static long long ckpt_at[MAX_CKPT], ckpt_offset[MAX_CKPT];
+static int n_ckpt, next_ckpt, next_mark;
+static char *ckpt_prefix = "ckpt";
+static char *restore_file = NULL;
+static int binary_trace;
+static int record_size = sizeof(trace_record);	/* of the binary trace */
+
+/* -sample unit,warm-up,period and -roi */
+static int sample_params[MAX_SWEEP], n_sample_params;
+static int roi = FALSE;
+static int sampling = FALSE;
+static int hierarchy = FALSE;
+
+/* -timing, -lat hit,c2c,mem[,l2[,llc]] and -bus width,arbitration */
+static int timing = FALSE;
+static int lat[MAX_SWEEP], n_lat;
+static int bus_params[MAX_SWEEP] = { DEFAULT_BUS_WIDTH, DEFAULT_BUS_ARB };
+
+/* -classify */
+static int classify = FALSE;
+
+/* -hot <k> */
+static int hot_k;
+
+/* -prefetch next|stride|stream */
+static int prefetch_kind = PREFETCH_NONE;
+
+/* -cores i-j:us,a,bs, per core geometries */
+static int n_core_groups;
+
+/* -wt, -nw and -wbuf <n> */
+static int write_through = FALSE, no_write_alloc = FALSE;
+static int wbuf_entries;
+
+/* -stats json|csv, -stats-file and the -interval time series */
+static int stats_format = STATS_TEXT;
+static char *stats_file = NULL;
+static long long interval, next_interval;
+static char *interval_file = DEFAULT_INTERVAL_FILE;
+static FILE *progress;			/* stderr when the records go to stdout */
+
+static trace_record batch[TRACE_BATCH];
+static long long num_inst = 0;
+
 
 int main(argc, argv)
   int argc;
   char **argv;
 {
+  int k;
+  struct timeval start, end;
+  struct rusage usage;
+  double seconds;
+
+  gettimeofday(&start, NULL);
   parse_args(argc, argv);
-  init_cache();
+  init_configs();
+  if (sampling)
+    sample_init(sample_params[0], sample_params[1], sample_params[2], roi);
+  if (n_threads > 1)
+    shard_start(n_threads);
   play_trace(traceFile);
-  print_stats();
+  if (stats_format != STATS_TEXT)
+    write_stats();
+  else if (sampling)
+    sample_report();
+  else if (n_configs > 1) {
+    print_stats_header();
+    for (k = 0; k < n_configs; k++) {
+      load_context(&configs[k]);
+      print_stats_row();
+    }
+  } else
+    print_stats();
+
+#ifdef CACHE_PROFILE
+  prof_report(progress);
+#endif
+
+  if (bench) {
+    gettimeofday(&end, NULL);
+    getrusage(RUSAGE_SELF, &usage);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) * 1e-6;
+    fprintf(progress, "  bench: %lld references in %.3f s, %.0f references/s, peak RSS %ld KB\n",
+           num_inst, seconds, seconds > 0 ? num_inst / seconds : 0.0, usage.ru_maxrss);
+  }
 }
 
 
@@ -24,6 +136,12 @@ void parse_args(argc, argv)
 {
   int arg_index, i, value;
 
+  n_usize = n_assoc = n_bsize = n_repl = 1;
+  sweep_repl[0] = DEFAULT_REPL;
+  sweep_usize[0] = DEFAULT_CACHE_SIZE;
+  sweep_assoc[0] = DEFAULT_CACHE_ASSOC;
+  sweep_bsize[0] = DEFAULT_CACHE_BLOCK_SIZE;
+
   if (argc < 2) {
     printf("usage:  cache <options> <trace file>\n");
     exit(-1);
@@ -37,7 +155,53 @@ void parse_args(argc, argv)
       printf("\t-bs <bs>: \tset cache block size to <bs>\n");
       printf("\t-us <us>: \tset unified cache size to <us>\n");
       printf("\t-a <a>: \tset cache associativity to <a>\n");
-      printf("\t-dg: \t\tEnable printing of debug messages\n");
+      printf("\t-repl <r>: \treplacement policy, LRU (default), PLRU, NRU, SRRIP,\n");
+      printf("\t\t\tBRRIP or random\n");
+      printf("\t\t\tcomma separated lists of -bs, -us, -a and -repl values\n");
+      printf("\t\t\tsweep every combination in one pass\n");
+      printf("\t-cores <i-j:us,a,bs>: give cores i to j their own cache size,\n");
+      printf("\t\t\tassociativity and block size (repeatable)\n");
+      printf("\t-dg: \t\tEnable printing of debug messages (sim-debug only)\n");
+      printf("\t-sf: \t\tProbe only sharers listed by a snoop filter\n");
+      printf("\t-proto <p>: \tcoherence protocol, MSI, MESI (default), MOESI or MESIF\n");
+      printf("\t-l2 <s>: \tadd a private L2 of <s> bytes per core\n");
+      printf("\t-l2a <a>: \tL2 associativity (%d)\n", DEFAULT_L2_ASSOC);
+      printf("\t-llc <s>: \tadd a shared last-level cache of <s> bytes\n");
+      printf("\t-llca <a>: \tLLC associativity (%d)\n", DEFAULT_LLC_ASSOC);
+      printf("\t-llc-policy <p>: inclusive (default), exclusive or nine\n");
+      printf("\t-timing: \tmodel latencies and a shared bus, report AMAT\n");
+      printf("\t-lat <h,c,m,l2,llc>: hit, cache to cache, memory, L2 and LLC\n");
+      printf("\t\t\tlatencies in cycles (%d,%d,%d,%d,%d), implies -timing\n",
+             DEFAULT_LAT_HIT, DEFAULT_LAT_C2C, DEFAULT_LAT_MEM, DEFAULT_LAT_L2, DEFAULT_LAT_LLC);
+      printf("\t-bus <w,a>: \tbus width in bytes and arbitration cycles (%d,%d)\n",
+             DEFAULT_BUS_WIDTH, DEFAULT_BUS_ARB);
+      printf("\t-classify: \tsplit misses into compulsory, capacity, conflict,\n");
+      printf("\t\t\ttrue sharing and false sharing\n");
+      printf("\t-hot <k>: \treport the <k> blocks with the most invalidations,\n");
+      printf("\t\t\ttransfers and write backs\n");
+      printf("\t-prefetch <p>: \tper core next, stride or stream prefetcher\n");
+      printf("\t-prefetch-degree <d>: blocks per prefetch trigger (%d)\n", DEFAULT_PREFETCH_DEGREE);
+      printf("\t-wb: \t\tset write policy to write back (default)\n");
+      printf("\t-wt: \t\tset write policy to write through\n");
+      printf("\t-wa: \t\tset allocation policy to write allocate (default)\n");
+      printf("\t-nw: \t\tset allocation policy to no write allocate\n");
+      printf("\t-wbuf <n>: \tcoalescing write buffer of <n> blocks per core\n");
+      printf("\t-stats <f>: \tprint the statistics as text (default), json or csv\n");
+      printf("\t-stats-file <f>: write -stats json or csv to <f>\n");
+      printf("\t-interval <n>: \twrite per core counter deltas every <n> references\n");
+      printf("\t-interval-file <f>: interval CSV file (%s)\n", DEFAULT_INTERVAL_FILE);
+      printf("\t-j <j>: \tsimulate disjoint set ranges on <j> threads\n");
+      printf("\t-p <p>: \tdecode text traces on <p> parser threads\n");
+      printf("\t-bench: \treport references per second and peak RSS\n");
+      printf("\t-nobatch: \treplay one reference at a time, to compare with\n");
+      printf("\t\t\tthe batched replay\n");
+      printf("\t-ckpt <r,r,..>: save cache state after <r> references\n");
+      printf("\t-ckpt-file <f>: checkpoint files are named <f>.<r> (ckpt)\n");
+      printf("\t-restore <f>: \tresume from checkpoint <f>\n");
+      printf("\t-sample <u,w,p>: measure <u> of every <p> references after\n");
+      printf("\t\t\ta <w> reference warm-up, with confidence intervals\n");
+      printf("\t-roi: \t\tmeasure only between region of interest markers\n");
+      printf("\n\t<trace file> may be text or binary (see validate/tracebin)\n");
       exit(0);
     }
     
@@ -54,89 +218,818 @@ void parse_args(argc, argv)
     }
 
     if (!strcmp(argv[arg_index], "-bs")) {
-      value = atoi(argv[arg_index+1]);
-      set_cache_param(CACHE_PARAM_BLOCK_SIZE, value);
+      n_bsize = parse_list(argv[arg_index+1], sweep_bsize);
+      set_cache_param(CACHE_PARAM_BLOCK_SIZE, sweep_bsize[0]);
       arg_index += 2;
       continue;
     }
 
     if (!strcmp(argv[arg_index], "-us")) {
-      value = atoi(argv[arg_index+1]);
-      set_cache_param(CACHE_PARAM_USIZE, value);
+      n_usize = parse_list(argv[arg_index+1], sweep_usize);
+      set_cache_param(CACHE_PARAM_USIZE, sweep_usize[0]);
       arg_index += 2;
       continue;
     }
 
     if (!strcmp(argv[arg_index], "-a")) {
-      value = atoi(argv[arg_index+1]);
-      set_cache_param(CACHE_PARAM_ASSOC, value);
+      n_assoc = parse_list(argv[arg_index+1], sweep_assoc);
+      set_cache_param(CACHE_PARAM_ASSOC, sweep_assoc[0]);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-cores")) {
+      parse_core_group(argv[arg_index+1]);
+      n_core_groups++;
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-repl")) {
+      n_repl = parse_repl_list(argv[arg_index+1], sweep_repl);
+      set_cache_param(PARAM_REPL, sweep_repl[0]);
       arg_index += 2;
       continue;
     }
 
     if(!strcmp(argv[arg_index], "-dg")) {
-       set_cache_param(PARAM_DEBUG, value);
+       debug_flag = TRUE;
+       set_cache_param(PARAM_DEBUG, TRUE);
        arg_index += 1;
        continue;
     }
 
+    if (!strcmp(argv[arg_index], "-proto")) {
+      value = find_protocol(argv[arg_index+1]);
+      if (value < 0) {
+        printf("error:  unknown protocol %s\n", argv[arg_index+1]);
+        exit(-1);
+      }
+      set_cache_param(PARAM_PROTOCOL, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-l2") || !strcmp(argv[arg_index], "-llc")) {
+      value = atoi(argv[arg_index+1]);
+      if (value <= 0) {
+        printf("error:  bad parameter value %s\n", argv[arg_index+1]);
+        exit(-1);
+      }
+      set_cache_param(argv[arg_index][2] == '2' ? PARAM_L2_USIZE : PARAM_LLC_USIZE, value);
+      hierarchy = TRUE;
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-l2a") || !strcmp(argv[arg_index], "-llca")) {
+      value = atoi(argv[arg_index+1]);
+      set_cache_param(argv[arg_index][2] == '2' ? PARAM_L2_ASSOC : PARAM_LLC_ASSOC, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-llc-policy")) {
+      value = find_llc_policy(argv[arg_index+1]);
+      if (value < 0) {
+        printf("error:  unknown LLC policy %s\n", argv[arg_index+1]);
+        exit(-1);
+      }
+      set_cache_param(PARAM_LLC_POLICY, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-classify")) {
+      classify = TRUE;
+      arg_index++;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-hot")) {
+      hot_k = atoi(argv[arg_index+1]);
+      if (hot_k < 1) {
+        printf("error:  -hot needs a positive number of blocks\n");
+        exit(-1);
+      }
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-prefetch")) {
+      prefetch_kind = find_prefetcher(argv[arg_index+1]);
+      if (prefetch_kind < 0) {
+        printf("error:  unknown prefetcher %s\n", argv[arg_index+1]);
+        exit(-1);
+      }
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-prefetch-degree")) {
+      value = atoi(argv[arg_index+1]);
+      set_cache_param(PARAM_PREFETCH_DEGREE, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-wb") || !strcmp(argv[arg_index], "-wt")) {
+      write_through = argv[arg_index][2] == 't';
+      set_cache_param(write_through ? CACHE_PARAM_WRITETHROUGH : CACHE_PARAM_WRITEBACK, 0);
+      arg_index++;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-wa") || !strcmp(argv[arg_index], "-nw")) {
+      no_write_alloc = argv[arg_index][1] == 'n';
+      set_cache_param(no_write_alloc ? CACHE_PARAM_NOWRITEALLOC : CACHE_PARAM_WRITEALLOC, 0);
+      arg_index++;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-wbuf")) {
+      wbuf_entries = atoi(argv[arg_index+1]);
+      if (wbuf_entries < 1) {
+        printf("error:  -wbuf needs a positive number of entries\n");
+        exit(-1);
+      }
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-stats")) {
+      stats_format = find_stats_format(argv[arg_index+1]);
+      if (stats_format < 0) {
+        printf("error:  unknown statistics format %s\n", argv[arg_index+1]);
+        exit(-1);
+      }
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-stats-file")) {
+      stats_file = argv[arg_index+1];
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-interval")) {
+      interval = atoll(argv[arg_index+1]);
+      if (interval < 1) {
+        printf("error:  -interval needs a positive number of references\n");
+        exit(-1);
+      }
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-interval-file")) {
+      interval_file = argv[arg_index+1];
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-timing")) {
+      timing = TRUE;
+      arg_index++;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-lat")) {
+      n_lat = parse_list(argv[arg_index+1], lat);
+      if (n_lat > 5) {
+        printf("error:  -lat takes at most 5 latencies\n");
+        exit(-1);
+      }
+      timing = TRUE;
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-bus")) {
+      if (parse_list(argv[arg_index+1], bus_params) != 2) {
+        printf("error:  -bus needs width,arbitration\n");
+        exit(-1);
+      }
+      timing = TRUE;
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-j")) {
+      n_threads = atoi(argv[arg_index+1]);
+      if (n_threads < 1 || n_threads > MAX_SHARDS) {
+        printf("error:  -j takes 1 to %d threads\n", MAX_SHARDS);
+        exit(-1);
+      }
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-p")) {
+      n_parsers = atoi(argv[arg_index+1]);
+      if (n_parsers < 1 || n_parsers > MAX_PARSERS) {
+        printf("error:  -p takes 1 to %d threads\n", MAX_PARSERS);
+        exit(-1);
+      }
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-bench")) {
+      bench = TRUE;
+      arg_index += 1;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-nobatch")) {
+      batched = FALSE;
+      arg_index += 1;
+      continue;
+    }
+
+    if(!strcmp(argv[arg_index], "-sf")) {
+       set_cache_param(PARAM_SNOOP_FILTER, 0);
+       arg_index += 1;
+       continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-ckpt")) {
+      n_ckpt = parse_counts(argv[arg_index+1], ckpt_at);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-ckpt-file")) {
+      ckpt_prefix = argv[arg_index+1];
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-restore")) {
+      restore_file = argv[arg_index+1];
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-sample")) {
+      n_sample_params = parse_list(argv[arg_index+1], sample_params);
+      if (n_sample_params != 3 ||
+          sample_params[0] + sample_params[1] > sample_params[2]) {
+        printf("error:  -sample needs unit,warm-up,period with unit + warm-up <= period\n");
+        exit(-1);
+      }
+      sampling = TRUE;
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-roi")) {
+      roi = TRUE;
+      sampling = TRUE;
+      arg_index++;
+      continue;
+    }
+
     printf("error:  unrecognized flag %s\n", argv[arg_index]);
     exit(-1);
 
   }
 
-  dump_settings();
+  if (n_threads > 1 && (debug_flag || SWEEP_SIZE > 1)) {
+    printf("error:  -j cannot be combined with -dg or a sweep\n");
+    exit(-1);
+  }
+  if (n_core_groups && (n_threads > 1 || SWEEP_SIZE > 1)) {
+    printf("error:  -cores cannot be combined with -j or a sweep\n");
+    exit(-1);
+  }
+  if (timing) {
+    if (n_threads > 1 || n_ckpt || restore_file || SWEEP_SIZE > 1) {
+      printf("error:  timing cannot be combined with -j, checkpoints or a sweep\n");
+      exit(-1);
+    }
+    set_cache_param(PARAM_TIMING, TRUE);
+    for (i = 0; i < n_lat; i++)
+      set_cache_param(PARAM_LAT_HIT + i, lat[i]);
+    set_cache_param(PARAM_BUS_WIDTH, bus_params[0]);
+    set_cache_param(PARAM_BUS_ARB, bus_params[1]);
+  }
+  if (classify) {
+    if (n_threads > 1 || n_ckpt || restore_file || SWEEP_SIZE > 1) {
+      printf("error:  -classify cannot be combined with -j, checkpoints or a sweep\n");
+      exit(-1);
+    }
+    set_cache_param(PARAM_CLASSIFY, TRUE);
+  }
+  if (hot_k) {
+    if (n_threads > 1 || n_ckpt || restore_file || SWEEP_SIZE > 1) {
+      printf("error:  -hot cannot be combined with -j, checkpoints or a sweep\n");
+      exit(-1);
+    }
+    set_cache_param(PARAM_HOT, hot_k);
+  }
+  if (prefetch_kind != PREFETCH_NONE) {
+    if (n_threads > 1 || n_ckpt || restore_file || SWEEP_SIZE > 1) {
+      printf("error:  -prefetch cannot be combined with -j, checkpoints or a sweep\n");
+      exit(-1);
+    }
+    set_cache_param(PARAM_PREFETCH, prefetch_kind);
+  }
+  if (wbuf_entries) {
+    if (!write_through && !no_write_alloc) {
+      printf("error:  -wbuf needs -wt or -nw\n");
+      exit(-1);
+    }
+    if (n_threads > 1 || n_ckpt || restore_file || SWEEP_SIZE > 1) {
+      printf("error:  -wbuf cannot be combined with -j, checkpoints or a sweep\n");
+      exit(-1);
+    }
+    set_cache_param(PARAM_WBUF, wbuf_entries);
+  }
+  if (interval && (n_threads > 1 || sampling || SWEEP_SIZE > 1)) {
+    printf("error:  -interval cannot be combined with -j, -sample, -roi or a sweep\n");
+    exit(-1);
+  }
+  if (stats_file && stats_format == STATS_TEXT) {
+    printf("error:  -stats-file needs -stats json or csv\n");
+    exit(-1);
+  }
+  if (hierarchy && (n_threads > 1 || n_ckpt || restore_file ||
+                    SWEEP_SIZE > 1)) {
+    printf("error:  -l2 and -llc cannot be combined with -j, checkpoints or a sweep\n");
+    exit(-1);
+  }
+  if (hierarchy && (write_through || no_write_alloc)) {
+    printf("error:  -l2 and -llc cannot be combined with -wt or -nw\n");
+    exit(-1);
+  }
+  if (sampling && (n_threads > 1 || n_ckpt || restore_file ||
+                   SWEEP_SIZE > 1)) {
+    printf("error:  -sample and -roi cannot be combined with -j, checkpoints or a sweep\n");
+    exit(-1);
+  }
+  if ((n_ckpt || restore_file) &&
+      (n_threads > 1 || n_parsers > 0 || SWEEP_SIZE > 1)) {
+    printf("error:  -ckpt and -restore cannot be combined with -j, -p or a sweep\n");
+    exit(-1);
+  }
+  /* the records carry the settings, and stdout carries only the records */
+  progress = stdout;
+  if (stats_format != STATS_TEXT && stats_file == NULL)
+    progress = stderr;
+  if (SWEEP_SIZE > 1) {
+    if (debug_flag) {
+      printf("error:  -dg cannot be combined with a sweep\n");
+      exit(-1);
+    }
+  } else if (progress == stdout)
+    dump_settings();
 
   /* open the trace file */
   traceFile = fopen(argv[arg_index], "r");
+  if (traceFile == NULL) {
+    printf("error:  unable to open trace file %s\n", argv[arg_index]);
+    exit(-1);
+  }
 
   return;
 }
 /************************************************************/
 
+/************************************************************/
+/* parses a comma separated list of positive values, returns its length */
+int parse_list(str, values)
+  char *str;
+  int *values;
+{
+  int n;
+
+  for (n = 0; ; n++) {
+    if (n == MAX_SWEEP) {
+      printf("error:  at most %d values per sweep list\n", MAX_SWEEP);
+      exit(-1);
+    }
+    values[n] = atoi(str);
+    if (values[n] <= 0) {
+      printf("error:  bad parameter value %s\n", str);
+      exit(-1);
+    }
+    str = strchr(str, ',');
+    if (str == NULL)
+      return(n + 1);
+    str++;
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* parses first-last:usize,assoc,block_size, or first:.. for one core */
+void parse_core_group(str)
+  char *str;
+{
+  int first, last, n, geometry[MAX_SWEEP];
+
+  if (sscanf(str, "%d-%d:%n", &first, &last, &n) != 2) {
+    if (sscanf(str, "%d:%n", &first, &n) != 1) {
+      printf("error:  -cores needs first-last:size,assoc,block\n");
+      exit(-1);
+    }
+    last = first;
+  }
+  if (parse_list(str + n, geometry) != 3) {
+    printf("error:  -cores needs first-last:size,assoc,block\n");
+    exit(-1);
+  }
+  set_core_geometry(first, last, geometry[0], geometry[1], geometry[2]);
+}
+
+/* parses a comma separated list of replacement policy names into REPL_
+   values, returns its length */
+int parse_repl_list(str, values)
+  char *str;
+  int *values;
+{
+  char name[32];
+  int n, len;
+
+  for (n = 0; ; n++) {
+    if (n == MAX_SWEEP) {
+      printf("error:  at most %d values per sweep list\n", MAX_SWEEP);
+      exit(-1);
+    }
+    len = strcspn(str, ",");
+    if (len >= (int)sizeof(name)) len = sizeof(name) - 1;
+    memcpy(name, str, len);
+    name[len] = '\0';
+    values[n] = find_repl_policy(name);
+    if (values[n] < 0) {
+      printf("error:  unknown replacement policy %s\n", name);
+      exit(-1);
+    }
+    str = strchr(str, ',');
+    if (str == NULL)
+      return(n + 1);
+    str++;
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* parses an increasing comma separated list of reference counts */
+int parse_counts(str, values)
+  char *str;
+  long long *values;
+{
+  int n;
+
+  for (n = 0; ; n++) {
+    if (n == MAX_CKPT) {
+      printf("error:  at most %d checkpoints\n", MAX_CKPT);
+      exit(-1);
+    }
+    values[n] = atoll(str);
+    if (values[n] <= 0 || (n > 0 && values[n] <= values[n-1])) {
+      printf("error:  bad checkpoint list %s\n", str);
+      exit(-1);
+    }
+    str = strchr(str, ',');
+    if (str == NULL)
+      return(n + 1);
+    str++;
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* builds one cache model per configuration of the sweep */
+void init_configs()
+{
+  int u, a, b, r;
+
+  n_configs = SWEEP_SIZE;
+  if (n_configs == 1) {
+    init_cache();
+    return;
+  }
+
+  configs = (Pcache_context)malloc(sizeof(cache_context) * n_configs);
+  if (configs == NULL) {
+    printf("error:  unable to allocate %d sweep configurations\n", n_configs);
+    exit(-1);
+  }
+
+  n_configs = 0;
+  for (b = 0; b < n_bsize; b++)
+    for (u = 0; u < n_usize; u++)
+      for (a = 0; a < n_assoc; a++)
+        for (r = 0; r < n_repl; r++) {
+          set_cache_param(CACHE_PARAM_BLOCK_SIZE, sweep_bsize[b]);
+          set_cache_param(CACHE_PARAM_USIZE, sweep_usize[u]);
+          set_cache_param(CACHE_PARAM_ASSOC, sweep_assoc[a]);
+          set_cache_param(PARAM_REPL, sweep_repl[r]);
+          init_cache();
+          save_context(&configs[n_configs++]);
+        }
+  fprintf(progress, "Sweeping %d configurations\n", n_configs);
+}
+/************************************************************/
+
 /************************************************************/
 void play_trace(inFile)
   FILE *inFile;
 {
-  unsigned addr, data, access_type, pid;
-  int num_inst;
+  unsigned long long addr;
+  unsigned access_type, pid;
+  int n, k;
+  long long restored, offset;
 
-  num_inst = 0;
-  while(read_trace_element(inFile, &pid, &access_type, &addr)) {
+  binary_trace = is_binary_trace(inFile);
+  if (restore_file) {
+    read_checkpoint(restore_file, &restored, &offset);
+    num_inst = restored;
+    while (next_ckpt < n_ckpt && ckpt_at[next_ckpt] <= num_inst)
+      next_ckpt++;
+    next_mark = next_ckpt;
+    if (!binary_trace && fseek(inFile, offset, SEEK_SET) < 0) {
+      printf("error:  unable to seek to checkpoint offset %lld\n", offset);
+      exit(-1);
+    }
+  }
 
-    switch (access_type) {
-    case TRACE_LOAD:
-    case TRACE_STORE:
-      perform_access(addr, access_type, pid);
-      break;
+  if (interval) {
+    interval_init(interval_file, num_inst);
+    next_interval = (num_inst / interval + 1) * interval;
+  }
 
-    default:
-      printf("skipping access, unknown type(%d)\n", access_type);
+  if (binary_trace)
+    play_binary_trace(inFile);
+  else if (n_parsers > 0)
+    pipeline_play(inFile, n_parsers, progress);
+  else {
+    n = 0;
+    while (1) {
+      if (next_mark < n_ckpt && num_inst + n == ckpt_at[next_mark])
+        ckpt_offset[next_mark++] = ftell(inFile);
+      if (!read_trace_element(inFile, &pid, &access_type, &addr))
+        break;
+      if (pid > 0xffff || access_type > 0xff) {
+        printf("error:  trace record %lld out of range\n", num_inst + n);
+        exit(-1);
+      }
+      batch[n].pid = pid;
+      batch[n].access_type = access_type;
+      batch[n].addr = addr;
+      if (++n == TRACE_BATCH) {
+        play_batch(batch, n);
+        n = 0;
+      }
     }
+    play_batch(batch, n);
+  }
 
-    num_inst++;
+  if (n_threads > 1)
+    shard_finish();
+  if (sampling)
+    sample_finish();
+  if (interval) {
+    interval_write(num_inst);
+    interval_finish();
+  }
+
+  for (k = 0; k < n_configs; k++) {
+    if (n_configs > 1) load_context(&configs[k]);
+    flush();
+    if (n_configs > 1) save_context(&configs[k]);
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* replays a binary trace in place through a read-only mapping */
+void play_binary_trace(inFile)
+  FILE *inFile;
+{
+  struct stat st;
+  char *map;
+  trace_header *header;
+  trace_record *rec, *end;
+  trace_record_32 *old, *old_end;
+  int n;
+
+  if (fstat(fileno(inFile), &st) < 0) {
+    printf("error:  unable to stat binary trace\n");
+    exit(-1);
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(inFile), 0);
+  if (map == MAP_FAILED) {
+    printf("error:  unable to map binary trace\n");
+    exit(-1);
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  header = (trace_header *)map;
+  if (header->version == TRACE_VERSION_32)
+    record_size = sizeof(trace_record_32);
+  if ((header->version != TRACE_VERSION && header->version != TRACE_VERSION_32) ||
+      header->record_size != (unsigned)record_size ||
+      (st.st_size - sizeof(trace_header)) % record_size) {
+    printf("error:  unsupported or truncated binary trace\n");
+    exit(-1);
+  }
+  if ((long long)((st.st_size - sizeof(trace_header)) / record_size) < num_inst) {
+    printf("error:  checkpoint lies beyond the end of the trace\n");
+    exit(-1);
+  }
+
+  if (header->version == TRACE_VERSION) {
+    rec = (trace_record *)(map + sizeof(trace_header)) + num_inst;
+    end = (trace_record *)(map + st.st_size);
+    for (; end - rec > TRACE_BATCH; rec += TRACE_BATCH)
+      play_batch(rec, TRACE_BATCH);
+    play_batch(rec, end - rec);
+  } else {
+    /* 32 bit records are widened a batch at a time */
+    old = (trace_record_32 *)(map + sizeof(trace_header)) + num_inst;
+    old_end = (trace_record_32 *)(map + st.st_size);
+    while (old < old_end) {
+      for (n = 0; n < TRACE_BATCH && old < old_end; n++, old++) {
+        batch[n].addr = old->addr;
+        batch[n].pid = old->pid;
+        batch[n].access_type = old->access_type;
+      }
+      play_batch(batch, n);
+    }
+  }
+
+  munmap(map, st.st_size);
+}
+/************************************************************/
+
+/************************************************************/
+/* runs a batch of references, stopping at each checkpoint and interval
+   boundary on the way */
+void play_batch(rec, n)
+  trace_record *rec;
+  int n;
+{
+  int m;
+  long long stop;
+
+  for (;;) {
+    stop = next_ckpt < n_ckpt ? ckpt_at[next_ckpt] : LLONG_MAX;
+    if (interval && next_interval < stop)
+      stop = next_interval;
+    if (num_inst + n < stop)
+      break;
+    m = stop - num_inst;
+    replay_batch(rec, m);
+    rec += m;
+    n -= m;
+    if (next_ckpt < n_ckpt && num_inst == ckpt_at[next_ckpt])
+      take_checkpoint();
+    if (interval && num_inst == next_interval) {
+      interval_write(num_inst);
+      next_interval += interval;
+    }
+  }
+  replay_batch(rec, n);
+}
+/************************************************************/
+
+/************************************************************/
+/* writes the final statistics of every configuration as JSON or CSV */
+void write_stats()
+{
+  FILE *f = stdout;
+  int k;
+
+  if (stats_file && (f = fopen(stats_file, "w")) == NULL) {
+    printf("error:  unable to create statistics file %s\n", stats_file);
+    exit(-1);
+  }
+  if (sampling)
+    sample_totals();
+  stats_begin(f, stats_format);
+  for (k = 0; k < n_configs; k++) {
+    if (n_configs > 1) load_context(&configs[k]);
+    stats_config(f, stats_format, k == 0);
+  }
+  stats_end(f, stats_format);
+  if (f != stdout && fclose(f) != 0) {
+    printf("error:  write to statistics file %s failed\n", stats_file);
+    exit(-1);
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* writes the checkpoint due at the current reference count */
+void take_checkpoint()
+{
+  char name[1024];
+  long long offset;
+
+  if (binary_trace)
+    offset = sizeof(trace_header) + num_inst * record_size;
+  else
+    offset = ckpt_offset[next_ckpt];
+  snprintf(name, sizeof(name), "%s.%lld", ckpt_prefix, ckpt_at[next_ckpt]);
+  write_checkpoint(name, num_inst, offset);
+  fprintf(progress, "checkpoint %s written at reference %lld\n", name, num_inst);
+  next_ckpt++;
+}
+/************************************************************/
+
+/************************************************************/
+/* runs references through every configuration */
+void simulate(rec, n)
+  trace_record *rec;
+  int n;
+{
+  int i, k;
+
+  if (n_threads > 1)
+    shard_play(rec, n);
+  else if (sampling)
+    sample_play(rec, n);
+  else for (k = 0; k < n_configs; k++) {
+    if (n_configs > 1) load_context(&configs[k]);
+    if (batched)
+      perform_batch(rec, n);
+    else for (i = 0; i < n; i++)
+      if (rec[i].access_type == TRACE_LOAD || rec[i].access_type == TRACE_STORE)
+        perform_access(rec[i].addr, rec[i].access_type, rec[i].pid);
+    if (n_configs > 1) save_context(&configs[k]);
+  }
+}
+
+#define KNOWN_TYPE(type) ((type) == TRACE_LOAD || (type) == TRACE_STORE || \
+                          (type) == TRACE_ROI_BEGIN || (type) == TRACE_ROI_END)
+
+/* Runs a batch of references. The batch is cut after each record that
+   prints a line, so the lines come out in trace order with the
+   simulation, as with one reference at a time. */
+void replay_batch(rec, n)
+  trace_record *rec;
+  int n;
+{
+  int i, j;
+
+  for (i = 0; i < n; i = j) {
+    for (j = i; j < n; j++) {
+      num_inst++;
+      if (!KNOWN_TYPE(rec[j].access_type) || !(num_inst % PRINT_INTERVAL)) {
+        j++;
+        break;
+      }
+    }
+    simulate(rec + i, j - i);
+    if (!KNOWN_TYPE(rec[j-1].access_type))
+      fprintf(progress, "skipping access, unknown type(%d)\n", rec[j-1].access_type);
     if (!(num_inst % PRINT_INTERVAL))
-      printf("processed %d references\n", num_inst);
+      fprintf(progress, "processed %lld references\n", num_inst);
   }
+}
+/************************************************************/
 
-  flush();
+/************************************************************/
+/* checks for the binary trace magic, leaving the file rewound */
+int is_binary_trace(inFile)
+  FILE *inFile;
+{
+  char magic[TRACE_MAGIC_SIZE];
+  int binary;
+
+  binary = fread(magic, 1, TRACE_MAGIC_SIZE, inFile) == TRACE_MAGIC_SIZE &&
+    !memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+  rewind(inFile);
+  return(binary);
 }
 /************************************************************/
 
 /************************************************************/
 int read_trace_element(inFile, pid, access_type, addr)
   FILE *inFile;
-  unsigned *pid, *access_type, *addr;
+  unsigned *pid, *access_type;
+  unsigned long long *addr;
 {
-  int result;
+  int result, record;
   char c;
 
-  result = fscanf(inFile, "%u %u %x%c", pid, access_type, addr, &c);
-  while (c != '\n') {
-    result = fscanf(inFile, "%c", &c);
-    if (result == EOF) 
-      break;
-  }
+  //Lines that are not records, such as comments, are skipped like the
+  //pipelined parser skips them
+  do {
+    c = 0;
+    result = fscanf(inFile, "%u %u %llx%c", pid, access_type, addr, &c);
+    record = result >= 3;
+    while (c != '\n') {
+      result = fscanf(inFile, "%c", &c);
+      if (result == EOF) 
+        break;
+    }
+  } while (result != EOF && !record);
   if (result != EOF)
     return(1);
   else
@@ -1,9 +1,26 @@
 #define TRACE_LOAD 0
 #define TRACE_STORE 1
+#define TRACE_ROI_BEGIN 3	/* region of interest markers, pid and addr unused */
+#define TRACE_ROI_END 4
 
 #define PRINT_INTERVAL 100000
+#define TRACE_BATCH 4096	/* references decoded and replayed at a time */
+#define MAX_SWEEP 16		/* values per -us/-a/-bs/-repl sweep list */
+#define MAX_CKPT 64		/* reference counts per -ckpt list */
 
 void parse_args();
 void play_trace();
+void play_binary_trace();
+void play_batch();
+void simulate();
+void replay_batch();
+void take_checkpoint();
+void write_stats();
+int parse_list();
+int parse_repl_list();
+void parse_core_group();
+int parse_counts();
+void init_configs();
+int is_binary_trace();
 int read_trace_element();
 
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "main.h"
+#include "trace.h"
+#include "ring.h"
+#include "pipeline.h"
+
+typedef struct parser_ {
+  pthread_t thread;
+  int id;
+  ring queue;			/* batches of this parser's chunks, in order */
+  double busy;			/* seconds spent decoding */
+  long records;
+} parser, *Pparser;
+
+static parser parsers[MAX_PARSERS];
+static int n_parsers;
+static const char *text;	/* mapped trace file */
+static long text_size;
+static long n_chunks;
+
+/************************************************************/
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+/************************************************************/
+
+/************************************************************/
+/* Decodes the line at *pp into rec with the same fields as the "%u %u %llx"
+   text reader, and advances *pp past the line. Returns 0 for blank and
+   comment lines. */
+static int parse_line(const char **pp, const char *end, trace_record *rec)
+{
+  const char *p = *pp;
+  unsigned long pid = 0, access_type = 0;
+  unsigned long long addr = 0;
+  int digits, d;
+
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    p++;
+  if (p == end || *p == '\n' || *p == '#') {
+    while (p < end && *p++ != '\n');
+    *pp = p;
+    return 0;
+  }
+
+  for (digits = 0; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+    pid = pid * 10 + (*p - '0');
+  if (!digits || pid > 0xffff)
+    goto bad;
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+
+  for (digits = 0; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+    access_type = access_type * 10 + (*p - '0');
+  if (!digits || access_type > 0xff)
+    goto bad;
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+    p += 2;
+  for (digits = 0; p < end; p++, digits++) {
+    if (*p >= '0' && *p <= '9') d = *p - '0';
+    else if (*p >= 'a' && *p <= 'f') d = *p - 'a' + 10;
+    else if (*p >= 'A' && *p <= 'F') d = *p - 'A' + 10;
+    else break;
+    if (addr >> 60)
+      goto bad;
+    addr = (addr << 4) | d;
+  }
+  if (!digits)
+    goto bad;
+
+  while (p < end && *p++ != '\n');
+  *pp = p;
+  rec->pid = pid;
+  rec->access_type = access_type;
+  rec->addr = addr;
+  memset(rec->reserved, 0, sizeof(rec->reserved));
+  return 1;
+
+bad:
+  printf("error:  malformed trace line at byte %ld\n", (long)(*pp - text));
+  exit(-1);
+}
+/************************************************************/
+
+/************************************************************/
+/* Decodes the lines starting in chunks id, id + n_parsers, ... A line
+   belongs to the chunk holding its first byte. */
+static void *parser_thread(void *arg)
+{
+  Pparser ps = (Pparser)arg;
+  const char *p, *chunk_end, *end = text + text_size;
+  pipe_batch *b;
+  long chunk;
+  double start;
+
+  for (chunk = ps->id; chunk < n_chunks; chunk += n_parsers) {
+    p = text + chunk * PIPE_CHUNK;
+    chunk_end = chunk == n_chunks - 1 ? end : p + PIPE_CHUNK;
+    if (chunk > 0)
+      while (p < end && p[-1] != '\n')
+        p++;
+
+    do {
+      b = (pipe_batch *)ring_reserve(&ps->queue);
+      start = now();
+      for (b->n = 0; b->n < PIPE_BATCH && p < chunk_end; )
+        b->n += parse_line(&p, end, &b->rec[b->n]);
+      b->last = p >= chunk_end;
+      ps->records += b->n;
+      ps->busy += now() - start;
+      ring_commit(&ps->queue);
+    } while (!b->last);
+  }
+  return NULL;
+}
+/************************************************************/
+
+/************************************************************/
+/* replays a text trace decoded by n parser threads */
+void pipeline_play(FILE *inFile, int n, FILE *f)
+{
+  struct stat st;
+  pipe_batch *b;
+  double start, wall, sim_busy = 0, parse_busy = 0;
+  long chunk, records = 0;
+  int k, last;
+
+  if (fstat(fileno(inFile), &st) < 0) {
+    printf("error:  unable to stat trace\n");
+    exit(-1);
+  }
+  text_size = st.st_size;
+  if (text_size == 0)
+    return;
+  text = mmap(NULL, text_size, PROT_READ, MAP_PRIVATE, fileno(inFile), 0);
+  if (text == MAP_FAILED) {
+    printf("error:  unable to map trace\n");
+    exit(-1);
+  }
+  madvise((void *)text, text_size, MADV_SEQUENTIAL);
+
+  n_chunks = (text_size + PIPE_CHUNK - 1) / PIPE_CHUNK;
+  n_parsers = n < n_chunks ? n : n_chunks;
+  wall = now();
+  for (k = 0; k < n_parsers; k++) {
+    parsers[k].id = k;
+    ring_init(&parsers[k].queue, sizeof(pipe_batch));
+    if (pthread_create(&parsers[k].thread, NULL, parser_thread, &parsers[k])) {
+      printf("error:  unable to start parser thread %d\n", k);
+      exit(-1);
+    }
+  }
+
+  for (chunk = 0; chunk < n_chunks; chunk++) {
+    do {
+      b = (pipe_batch *)ring_peek(&parsers[chunk % n_parsers].queue);
+      start = now();
+      play_batch(b->rec, b->n);
+      sim_busy += now() - start;
+      records += b->n;
+      last = b->last;
+      ring_release(&parsers[chunk % n_parsers].queue);
+    } while (!last);
+  }
+
+  for (k = 0; k < n_parsers; k++) {
+    pthread_join(parsers[k].thread, NULL);
+    parse_busy += parsers[k].busy;
+  }
+  wall = now() - wall;
+  munmap((void *)text, text_size);
+
+  fprintf(f, "pipeline: %ld references in %.3f s with %d parser thread(s)\n", records, wall, n_parsers);
+  fprintf(f, "  parse:    %.3f s busy, %.2f Mref/s per thread, %.2f MB/s across threads\n", parse_busy,
+         parse_busy > 0 ? records / parse_busy * 1e-6 : 0.0,
+         parse_busy > 0 ? text_size / parse_busy * 1e-6 * n_parsers : 0.0);
+  fprintf(f, "  simulate: %.3f s busy, %.2f Mref/s\n", sim_busy,
+         sim_busy > 0 ? records / sim_busy * 1e-6 : 0.0);
+}
+/************************************************************/
@@ -0,0 +1,14 @@
+/* Pipelined text trace ingestion: parser threads decode newline aligned
+   chunks of a mapped text trace into batches of trace_records, and the
+   simulation thread replays the chunks in file order as they complete. */
+#define PIPE_CHUNK (1 << 20)	/* bytes of text per chunk */
+#define PIPE_BATCH 4096		/* records per ring slot */
+#define MAX_PARSERS 32
+
+typedef struct pipe_batch_ {
+  int n;			/* number of records */
+  int last;			/* last batch of its chunk */
+  trace_record rec[PIPE_BATCH];
+} pipe_batch;
+
+void pipeline_play(FILE *inFile, int n_parsers, FILE *f);
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "cache.h"
+#include "prefetch.h"
+#include "timing.h"
+
+static char *prefetch_names[] = { "none", "next", "stride", "stream" };
+
+/* Per thread, like the model of cache.c; see prefetch_save() */
+static __thread int kind = PREFETCH_NONE;
+static __thread int degree = DEFAULT_PREFETCH_DEGREE;
+static __thread int num_core;
+static __thread int lines;		/* lines per core */
+static __thread int page_shift;		/* block number to page number */
+static __thread long long references;	/* demand references so far */
+
+/* prefetched lines not yet used, by pid * lines + line */
+static __thread long long *issued_at;	/* reference that prefetched the line, 0 if none */
+static __thread long long *ready_at;	/* cycle its fill completes, with -timing */
+
+/* stride table: last block and stride seen in each recent page */
+typedef struct stride_entry_ {
+  unsigned long long page;
+  unsigned long long last;
+  long long stride;
+  int confidence;
+} stride_entry;
+
+/* stream table: last miss and direction of each recent stream, and the
+   furthest block fetched for it */
+typedef struct stream_entry_ {
+  unsigned long long last;
+  unsigned long long next;
+  int dir;				/* +1, -1, 0 while untrained */
+  int confidence;
+} stream_entry;
+
+static __thread stride_entry *strides;	/* PREFETCH_TABLE per core */
+static __thread stream_entry *streams;
+static __thread int *victim;		/* next table entry each core replaces */
+
+#define CONFIDENT 2
+
+/************************************************************/
+static void *alloc(size_t n, size_t size)
+{
+  void *p = calloc(n, size);
+
+  if (p == NULL) {
+    printf("error : Memory allocation failed for the prefetchers\n");
+    exit(-1);
+  }
+  return p;
+}
+
+void prefetch_init(int k, int d, int n_cores, int lines_per_core,
+                   int block_bits, int timed)
+{
+  kind = k;
+  degree = d;
+  num_core = n_cores;
+  lines = lines_per_core;
+  page_shift = STRIDE_PAGE_BITS > block_bits ? STRIDE_PAGE_BITS - block_bits : 0;
+  references = 0;
+
+  issued_at = (long long *)alloc((size_t)n_cores * lines, sizeof(long long));
+  ready_at = timed ? (long long *)alloc((size_t)n_cores * lines, sizeof(long long)) : NULL;
+  strides = (stride_entry *)alloc((size_t)n_cores * PREFETCH_TABLE, sizeof(stride_entry));
+  streams = (stream_entry *)alloc((size_t)n_cores * PREFETCH_TABLE, sizeof(stream_entry));
+  victim = (int *)alloc(n_cores, sizeof(int));
+}
+/************************************************************/
+
+/************************************************************/
+/* Training. Each prefetcher sees the block of every demand reference and
+   whether it triggers, that is missed or used a prefetched line. */
+
+static void next_line(unsigned long long block, unsigned pid, int trigger)
+{
+  int i;
+
+  if (trigger)
+    for (i = 1; i <= degree; i++)
+      prefetch_block(block + i, pid);
+}
+
+static void stride(unsigned long long block, unsigned pid)
+{
+  stride_entry *e, *table = &strides[(size_t)pid * PREFETCH_TABLE];
+  unsigned long long page = block >> page_shift;
+  long long delta;
+  int i;
+
+  for (i = 0; i < PREFETCH_TABLE && table[i].page != page; i++)
+    ;
+  if (i == PREFETCH_TABLE) {
+    e = &table[victim[pid]];
+    victim[pid] = (victim[pid] + 1) % PREFETCH_TABLE;
+    e->page = page;
+    e->last = block;
+    e->stride = 0;
+    e->confidence = 0;
+    return;
+  }
+
+  e = &table[i];
+  delta = (long long)(block - e->last);
+  if (delta == 0)
+    return;
+  if (delta == e->stride) {
+    if (e->confidence < CONFIDENT)
+      e->confidence++;
+  } else {
+    e->stride = delta;
+    e->confidence = 0;
+  }
+  e->last = block;
+
+  if (e->confidence == CONFIDENT)
+    for (i = 1; i <= degree; i++) {
+      if (e->stride < 0 && block < (unsigned long long)(-i * e->stride))
+        break;
+      prefetch_block(block + i * e->stride, pid);
+    }
+}
+
+static void stream(unsigned long long block, unsigned pid, int trigger)
+{
+  stream_entry *e, *table = &streams[(size_t)pid * PREFETCH_TABLE];
+  long long delta;
+  int i, dir;
+
+  if (!trigger)
+    return;
+  for (i = 0; i < PREFETCH_TABLE; i++) {
+    delta = (long long)(block - table[i].last);
+    if (table[i].confidence && delta >= -STREAM_WINDOW && delta <= STREAM_WINDOW)
+      break;
+  }
+  if (i == PREFETCH_TABLE) {
+    e = &table[victim[pid]];
+    victim[pid] = (victim[pid] + 1) % PREFETCH_TABLE;
+    e->last = e->next = block;
+    e->dir = 0;
+    e->confidence = 1;
+    return;
+  }
+
+  e = &table[i];
+  if (delta == 0)
+    return;
+  dir = delta > 0 ? 1 : -1;
+  if (dir == e->dir) {
+    if (e->confidence < CONFIDENT)
+      e->confidence++;
+  } else {
+    e->dir = dir;
+    e->confidence = 1;
+    e->next = block;
+  }
+  e->last = block;
+  if (e->confidence < CONFIDENT)
+    return;
+
+  /* the window runs from the current block to STREAM_DISTANCE ahead */
+  if ((long long)(e->next - block) * dir < 0)
+    e->next = block;
+  for (i = 0; i < degree && (long long)(e->next - block) * dir < STREAM_DISTANCE; i++) {
+    if (dir < 0 && e->next == 0)
+      break;
+    e->next += dir;
+    prefetch_block(e->next, pid);
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* Called after every demand reference of pid to block, which ended up in
+   line, -1 for a write miss that did not allocate. Returns TRUE if it was
+   the first use of a prefetched line. */
+int prefetch_access(unsigned long long block, unsigned pid, int line, int hit)
+{
+  Pcache_stat st = core_stats(pid);
+  size_t slot = (size_t)pid * lines + line;
+  int first_use = FALSE;
+
+  references++;
+  if (line >= 0 && issued_at[slot]) {
+    if (hit) {
+      first_use = TRUE;
+      st->prefetch_hits++;
+      st->prefetch_distance += references - issued_at[slot];
+      if (ready_at && timing_wait(ready_at[slot]))
+        st->prefetch_late++;
+    }
+    issued_at[slot] = 0;
+  }
+
+  switch (kind) {
+    case PREFETCH_NEXT:
+      next_line(block, pid, !hit || first_use);
+      break;
+    case PREFETCH_STRIDE:
+      stride(block, pid);
+      break;
+    case PREFETCH_STREAM:
+      stream(block, pid, !hit || first_use);
+      break;
+  }
+  return first_use;
+}
+
+/* a prefetch of pid filled line, the fill completing at cycle ready */
+void prefetch_filled(unsigned pid, int line, long long ready)
+{
+  size_t slot = (size_t)pid * lines + line;
+
+  issued_at[slot] = references;
+  if (ready_at)
+    ready_at[slot] = ready;
+}
+
+/* a remote write took line of pid away */
+void prefetch_invalidate(unsigned pid, int line)
+{
+  size_t slot = (size_t)pid * lines + line;
+
+  if (issued_at[slot]) {
+    core_stats(pid)->prefetch_invalidated++;
+    issued_at[slot] = 0;
+  }
+}
+/************************************************************/
+
+/************************************************************/
+void print_prefetch_stats()
+{
+  int i;
+  Pcache_stat st;
+  cache_stat t;
+
+  memset(&t, 0, sizeof(t));
+  printf("\n");
+  printf("  PREFETCH (%s, degree %d)\n", prefetch_names[kind], degree);
+  for (i = 0; i < num_core; i++) {
+    st = core_stats(i);
+    printf("  CORE %d: issued %lld, useful %lld, accuracy %f, coverage %f\n", i,
+           st->prefetches, st->prefetch_hits,
+           st->prefetches ? (double)st->prefetch_hits / st->prefetches : 0.0,
+           st->prefetch_hits + st->misses ? (double)st->prefetch_hits / (st->prefetch_hits + st->misses) : 0.0);
+    t.prefetches += st->prefetches;
+    t.prefetch_hits += st->prefetch_hits;
+    t.prefetch_late += st->prefetch_late;
+    t.prefetch_invalidated += st->prefetch_invalidated;
+    t.prefetch_distance += st->prefetch_distance;
+    t.prefetch_broadcasts += st->prefetch_broadcasts;
+    t.misses += st->misses;
+  }
+  printf("  prefetches issued:    %lld\n", t.prefetches);
+  printf("  useful prefetches:    %lld\n", t.prefetch_hits);
+  printf("  accuracy:             %f\n",
+         t.prefetches ? (double)t.prefetch_hits / t.prefetches : 0.0);
+  printf("  coverage:             %f (of misses without prefetching)\n",
+         t.prefetch_hits + t.misses ? (double)t.prefetch_hits / (t.prefetch_hits + t.misses) : 0.0);
+  if (ready_at)
+    printf("  late prefetches:      %lld\n", t.prefetch_late);
+  printf("  mean use distance:    %f references\n",
+         t.prefetch_hits ? (double)t.prefetch_distance / t.prefetch_hits : 0.0);
+  printf("  invalidated unused:   %lld\n", t.prefetch_invalidated);
+  printf("  prefetch broadcasts:  %lld\n", t.prefetch_broadcasts);
+}
+
+/* the name of a PREFETCH_ kind, usable before prefetch_init() */
+char *prefetch_name(int k)
+{
+  return prefetch_names[k];
+}
+
+/* returns the PREFETCH_ kind for a name, -1 if unknown */
+int find_prefetcher(char *name)
+{
+  int k;
+
+  for (k = 0; k < 4; k++)
+    if (!strcasecmp(name, prefetch_names[k]))
+      return k;
+  return -1;
+}
+/************************************************************/
+
+/************************************************************/
+/* copies the prefetchers of this thread into ctx, prefetch_load() puts them
+   back */
+void prefetch_save(prefetch_context *ctx)
+{
+  ctx->kind = kind;
+  ctx->degree = degree;
+  ctx->num_core = num_core;
+  ctx->lines = lines;
+  ctx->page_shift = page_shift;
+  ctx->references = references;
+  ctx->issued_at = issued_at;
+  ctx->ready_at = ready_at;
+  ctx->strides = strides;
+  ctx->streams = streams;
+  ctx->victim = victim;
+}
+
+void prefetch_load(prefetch_context *ctx)
+{
+  kind = ctx->kind;
+  degree = ctx->degree;
+  num_core = ctx->num_core;
+  lines = ctx->lines;
+  page_shift = ctx->page_shift;
+  references = ctx->references;
+  issued_at = ctx->issued_at;
+  ready_at = ctx->ready_at;
+  strides = ctx->strides;
+  streams = ctx->streams;
+  victim = ctx->victim;
+}
+
+void prefetch_free(prefetch_context *ctx)
+{
+  free(ctx->issued_at);
+  free(ctx->ready_at);
+  free(ctx->strides);
+  free(ctx->streams);
+  free(ctx->victim);
+}
+/************************************************************/
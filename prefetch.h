@@ -0,0 +1,51 @@
+/* Optional hardware prefetchers, one per core. Prefetches are coherent
+   read requests. Like a demand read miss, a prefetch broadcasts, may take
+   the block from another core, evicts a victim and fills from the levels
+   below, but it is charged to the prefetch counters rather than to the
+   demand ones. Three prefetchers are modelled:
+     next    on a miss, or on the first use of a prefetched line, fetches
+             the next <degree> blocks
+     stride  a table of recent pages per core learns the stride between
+             accesses to each page. Once the same stride repeats, it
+             fetches <degree> strides ahead
+     stream  a table of miss streams per core learns their direction.
+             Once a stream is confirmed, it keeps a window of
+             STREAM_DISTANCE blocks ahead of the stream fetched, <degree>
+             blocks per trigger
+   A prefetch is useful if a demand reference hits its line before the line
+   is replaced or invalidated. With -timing, a prefetch is late if that
+   reference arrives before the fill completes, and the reference waits
+   for the rest of the fill. */
+#define PREFETCH_NONE 0
+#define PREFETCH_NEXT 1
+#define PREFETCH_STRIDE 2
+#define PREFETCH_STREAM 3
+#define DEFAULT_PREFETCH_DEGREE 2
+
+#define PREFETCH_TABLE 16	/* stride or stream entries per core */
+#define STRIDE_PAGE_BITS 12	/* the stride table tracks 4 KB pages */
+#define STREAM_WINDOW 16	/* blocks from a stream's last miss that join it */
+#define STREAM_DISTANCE 8	/* blocks a stream is fetched ahead */
+
+/* the prefetchers of one cache_context, see save_context(); the tables
+   are private to prefetch.c */
+typedef struct prefetch_context_ {
+  int kind, degree, num_core, lines, page_shift;
+  long long references;
+  long long *issued_at, *ready_at;
+  struct stride_entry_ *strides;
+  struct stream_entry_ *streams;
+  int *victim;
+} prefetch_context;
+
+void prefetch_init(int kind, int degree, int n_cores, int lines_per_core,
+                   int block_bits, int timed);
+int prefetch_access(unsigned long long block, unsigned pid, int line, int hit);
+void prefetch_filled(unsigned pid, int line, long long ready);
+void prefetch_invalidate(unsigned pid, int line);
+void print_prefetch_stats();
+char *prefetch_name(int k);
+int find_prefetcher(char *name);
+void prefetch_save(prefetch_context *ctx);
+void prefetch_load(prefetch_context *ctx);
+void prefetch_free(prefetch_context *ctx);
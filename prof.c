@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "prof.h"
+
+typedef struct prof_data_ {
+  unsigned long long count[PROF_PHASES];
+  unsigned long long cycles[PROF_PHASES];
+  unsigned long long hist[PROF_PHASES][PROF_BUCKETS];
+} prof_data;
+
+static const char *phase_names[PROF_PHASES] =
+  { "lookup", "broadcast", "transition", "lru" };
+
+/* each thread profiles into its own counters, which prof_flush() folds
+   into the process total */
+static __thread prof_data local;
+static prof_data total;
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#if defined(CACHE_PROFILE) && !defined(__x86_64__) && !defined(__i386__)
+/************************************************************/
+/* nanoseconds stand in for cycles where there is no time stamp counter */
+unsigned long long read_cycles()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+/************************************************************/
+#endif
+
+/************************************************************/
+void prof_record(int phase, unsigned long long cycles)
+{
+  int bucket;
+
+  bucket = cycles ? 63 - __builtin_clzll(cycles) : 0;
+  if (bucket >= PROF_BUCKETS)
+    bucket = PROF_BUCKETS - 1;
+  local.count[phase]++;
+  local.cycles[phase] += cycles;
+  local.hist[phase][bucket]++;
+}
+/************************************************************/
+
+/************************************************************/
+void prof_flush()
+{
+  int p, b;
+
+  pthread_mutex_lock(&total_lock);
+  for (p = 0; p < PROF_PHASES; p++) {
+    total.count[p] += local.count[p];
+    total.cycles[p] += local.cycles[p];
+    for (b = 0; b < PROF_BUCKETS; b++)
+      total.hist[p][b] += local.hist[p][b];
+  }
+  pthread_mutex_unlock(&total_lock);
+  memset(&local, 0, sizeof(prof_data));
+}
+/************************************************************/
+
+/************************************************************/
+void prof_report(FILE *f)
+{
+  int p, b;
+
+  prof_flush();
+  fprintf(f, "\n*** HOT PATH PROFILE (cycles) ***\n");
+  for (p = 0; p < PROF_PHASES; p++) {
+    fprintf(f, "  %-10s  calls: %llu  total: %llu  mean: %.1f\n", phase_names[p],
+           total.count[p], total.cycles[p],
+           total.count[p] ? (double)total.cycles[p] / total.count[p] : 0.0);
+    for (b = 0; b < PROF_BUCKETS; b++)
+      if (total.hist[p][b])
+        fprintf(f, "    [%10llu, %10llu)  %llu\n", b ? 1ULL << b : 0, 2ULL << b, total.hist[p][b]);
+  }
+}
+/************************************************************/
@@ -0,0 +1,27 @@
+/* Hot path profiling, compiled in only with -DCACHE_PROFILE ("make
+   sim-prof"). Each phase of an access is timed in cycles and binned in a
+   log2 histogram that is printed at exit. Broadcast time includes the
+   remote lookups and remote transitions it performs. */
+#define PROF_LOOKUP 0		/* local tag search */
+#define PROF_BROADCAST 1	/* BroadcastnSearch */
+#define PROF_TRANSITION 2	/* MESI state transitions */
+#define PROF_LRU 3		/* LRU update, victim selection, fill */
+#define PROF_PHASES 4
+#define PROF_BUCKETS 32		/* bucket b counts [2^b, 2^(b+1)) cycles */
+
+#ifdef CACHE_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#define read_cycles() __builtin_ia32_rdtsc()
+#else
+unsigned long long read_cycles();
+#endif
+#define PROF_START(t) unsigned long long t = read_cycles()
+#define PROF_END(phase, t) prof_record(phase, read_cycles() - (t))
+#else
+#define PROF_START(t)
+#define PROF_END(phase, t)
+#endif
+
+void prof_record(int phase, unsigned long long cycles);
+void prof_flush();
+void prof_report(FILE *f);
@@ -0,0 +1,86 @@
+#include <strings.h>
+
+#include "cache.h"
+#include "protocol.h"
+
+/* table entries: an impossible event, a plain transition, one that writes
+   the block back and one that needs an invalidating broadcast */
+#define X	{ INVALID_STATE, T_ERROR }
+#define TO(s)	{ s##_STATE, 0 }
+#define WB(s)	{ s##_STATE, T_COPY_BACK }
+#define BC(s)	{ s##_STATE, T_BROADCAST }
+
+/* Misses always start from INVALID, the state a missing line is filled
+   from, so only that column of the miss events is reachable. Columns are
+   I, E, S, M, O, F. */
+const protocol protocols[N_PROTOCOLS] = {
+  { "MSI",
+    { /* READ_HIT */               { X, X, TO(SHARED), TO(MODIFIED), X, X },
+      /* READ_MISS_FROM_BUS */     { TO(SHARED), X, X, X, X, X },
+      /* READ_MISS_FROM_MEMORY */  { TO(SHARED), X, X, X, X, X },
+      /* WRITE_HIT */              { X, X, BC(MODIFIED), TO(MODIFIED), X, X },
+      /* WRITE_MISS_FROM_BUS */    { TO(MODIFIED), X, X, X, X, X },
+      /* WRITE_MISS_FROM_MEMORY */ { TO(MODIFIED), X, X, X, X, X },
+      /* REMOTE_READ_MISS */       { X, X, TO(SHARED), WB(SHARED), X, X },
+      /* REMOTE_WRITE_HIT */       { X, X, TO(INVALID), X, X, X },
+      /* REMOTE_WRITE_MISS */      { X, X, TO(INVALID), TO(INVALID), X, X } },
+    /* dirty */    { 0, 0, 0, 1, 0, 0 },
+    /* supplies */ { 0, 0, 1, 1, 0, 0 } },
+
+  { "MESI",
+    { /* READ_HIT */               { X, TO(EXCLUSIVE), TO(SHARED), TO(MODIFIED), X, X },
+      /* READ_MISS_FROM_BUS */     { TO(SHARED), X, X, X, X, X },
+      /* READ_MISS_FROM_MEMORY */  { TO(EXCLUSIVE), X, X, X, X, X },
+      /* WRITE_HIT */              { X, TO(MODIFIED), BC(MODIFIED), TO(MODIFIED), X, X },
+      /* WRITE_MISS_FROM_BUS */    { TO(MODIFIED), X, X, X, X, X },
+      /* WRITE_MISS_FROM_MEMORY */ { TO(MODIFIED), X, X, X, X, X },
+      /* REMOTE_READ_MISS */       { X, TO(SHARED), TO(SHARED), WB(SHARED), X, X },
+      /* REMOTE_WRITE_HIT */       { X, X, TO(INVALID), X, X, X },
+      /* REMOTE_WRITE_MISS */      { X, TO(INVALID), TO(INVALID), TO(INVALID), X, X } },
+    /* dirty */    { 0, 0, 0, 1, 0, 0 },
+    /* supplies */ { 0, 1, 1, 1, 0, 0 } },
+
+  /* a modified line that is read remotely becomes OWNED and keeps
+     supplying the dirty data instead of writing it back */
+  { "MOESI",
+    { /* READ_HIT */               { X, TO(EXCLUSIVE), TO(SHARED), TO(MODIFIED), TO(OWNED), X },
+      /* READ_MISS_FROM_BUS */     { TO(SHARED), X, X, X, X, X },
+      /* READ_MISS_FROM_MEMORY */  { TO(EXCLUSIVE), X, X, X, X, X },
+      /* WRITE_HIT */              { X, TO(MODIFIED), BC(MODIFIED), TO(MODIFIED), BC(MODIFIED), X },
+      /* WRITE_MISS_FROM_BUS */    { TO(MODIFIED), X, X, X, X, X },
+      /* WRITE_MISS_FROM_MEMORY */ { TO(MODIFIED), X, X, X, X, X },
+      /* REMOTE_READ_MISS */       { X, TO(SHARED), TO(SHARED), TO(OWNED), TO(OWNED), X },
+      /* REMOTE_WRITE_HIT */       { X, X, TO(INVALID), X, TO(INVALID), X },
+      /* REMOTE_WRITE_MISS */      { X, TO(INVALID), TO(INVALID), TO(INVALID), TO(INVALID), X } },
+    /* dirty */    { 0, 0, 0, 1, 1, 0 },
+    /* supplies */ { 0, 1, 1, 1, 1, 0 } },
+
+  /* the latest reader of a shared line holds it in FORWARD and is the
+     only sharer that answers misses, plain SHARED copies leave it to
+     memory */
+  { "MESIF",
+    { /* READ_HIT */               { X, TO(EXCLUSIVE), TO(SHARED), TO(MODIFIED), X, TO(FORWARD) },
+      /* READ_MISS_FROM_BUS */     { TO(FORWARD), X, X, X, X, X },
+      /* READ_MISS_FROM_MEMORY */  { TO(EXCLUSIVE), X, X, X, X, X },
+      /* WRITE_HIT */              { X, TO(MODIFIED), BC(MODIFIED), TO(MODIFIED), X, BC(MODIFIED) },
+      /* WRITE_MISS_FROM_BUS */    { TO(MODIFIED), X, X, X, X, X },
+      /* WRITE_MISS_FROM_MEMORY */ { TO(MODIFIED), X, X, X, X, X },
+      /* REMOTE_READ_MISS */       { X, TO(SHARED), TO(SHARED), WB(SHARED), X, TO(SHARED) },
+      /* REMOTE_WRITE_HIT */       { X, X, TO(INVALID), X, X, TO(INVALID) },
+      /* REMOTE_WRITE_MISS */      { X, TO(INVALID), TO(INVALID), TO(INVALID), X, TO(INVALID) } },
+    /* dirty */    { 0, 0, 0, 1, 0, 0 },
+    /* supplies */ { 0, 1, 0, 1, 0, 1 } },
+};
+
+/************************************************************/
+/* returns the PROTO_ number of a protocol name, -1 if unknown */
+int find_protocol(char *name)
+{
+  int p;
+
+  for (p = 0; p < N_PROTOCOLS; p++)
+    if (!strcasecmp(name, protocols[p].name))
+      return p;
+  return -1;
+}
+/************************************************************/
@@ -0,0 +1,33 @@
+/* Coherence protocols as transition tables. Each table is indexed by the
+   event (READ_HIT .. REMOTE_WRITE_MISS of cache.h) and the current state
+   of the line, and gives the next state plus what the transition costs. */
+#define N_STATES 6
+#define N_EVENTS 9
+
+/* transition flags */
+#define T_ERROR 1		/* the event cannot happen in this state */
+#define T_COPY_BACK 2		/* the snooping cache writes the block back */
+#define T_BROADCAST 4		/* a local write hit must invalidate other copies */
+
+typedef struct transition_ {
+  unsigned char next;		/* state after the event */
+  unsigned char flags;
+} transition;
+
+typedef struct protocol_ {
+  char *name;
+  transition table[N_EVENTS][N_STATES];
+  unsigned char dirty[N_STATES];	/* evicting the line writes it back */
+  unsigned char supplies[N_STATES];	/* a copy in this state answers a miss */
+} protocol;
+
+#define PROTO_MSI 0
+#define PROTO_MESI 1
+#define PROTO_MOESI 2
+#define PROTO_MESIF 3
+#define N_PROTOCOLS 4
+#define DEFAULT_PROTOCOL PROTO_MESI
+
+extern const protocol protocols[N_PROTOCOLS];
+
+int find_protocol(char *name);
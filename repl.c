@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "cache.h"
+#include "repl.h"
+
+/* PLRU tree nodes are numbered 1 .. associativity - 1 from the root, the
+   children of node n being 2n and 2n + 1, and node n is bit n of the set's
+   word. A set bit sends the victim search right. Touching a way points
+   every node on its path away from it: plru_path[a][way] has the bits of
+   those nodes and plru_away[a][way] their new values, for associativity
+   1 << a. They are built once for the process, whichever thread first
+   needs them. */
+#define PLRU_LEVELS 7
+static unsigned long long plru_path[PLRU_LEVELS][64], plru_away[PLRU_LEVELS][64];
+static pthread_once_t plru_once = PTHREAD_ONCE_INIT;
+
+#define RRPV_NEAR 0
+#define RRPV_LONG 2
+#define RRPV_DISTANT 3
+#define BRRIP_LONG_ONE_IN 32
+
+#define WAY(c, index, line) ((line) - (int)(index) * (c)->associativity)
+
+/************************************************************/
+static void build_plru_tables()
+{
+  int a, way, level, node;
+
+  for (a = 0; a < PLRU_LEVELS; a++)
+    for (way = 0; way < (1 << a); way++) {
+      node = 1;
+      for (level = a - 1; level >= 0; level--) {
+        plru_path[a][way] |= 1ULL << node;
+        if (!((way >> level) & 1))
+          plru_away[a][way] |= 1ULL << node;
+        node = 2 * node + ((way >> level) & 1);
+      }
+    }
+}
+
+/* xorshift32 step of the generator of one set */
+static unsigned draw(Pcache c, unsigned index)
+{
+  unsigned x = c->seeds[index];
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  c->seeds[index] = x;
+  return x;
+}
+
+/* the low bit of every 2 bit prediction of a set */
+static unsigned long long rrpv_ones(Pcache c)
+{
+  return 0x5555555555555555ULL >> (64 - 2 * c->associativity);
+}
+/************************************************************/
+
+/************************************************************/
+static void plru_touch(Pcache c, unsigned index, int line)
+{
+  int a = LOG2(c->associativity), way = WAY(c, index, line);
+
+  c->repl[index] = (c->repl[index] & ~plru_path[a][way]) | plru_away[a][way];
+}
+
+static int plru_victim(Pcache c, unsigned index)
+{
+  unsigned long long bits = c->repl[index];
+  int node = 1;
+
+  while (node < c->associativity)
+    node = 2 * node + ((bits >> node) & 1);
+  return index * c->associativity + node - c->associativity;
+}
+
+static void nru_touch(Pcache c, unsigned index, int line)
+{
+  unsigned long long all = ~0ULL >> (64 - c->associativity);
+  unsigned long long used = 1ULL << WAY(c, index, line);
+
+  c->repl[index] |= used;
+  if (c->repl[index] == all)
+    c->repl[index] = used;
+}
+
+static int nru_victim(Pcache c, unsigned index)
+{
+  unsigned long long unused = ~c->repl[index] & (~0ULL >> (64 - c->associativity));
+
+  return index * c->associativity + (unused ? __builtin_ctzll(unused) : 0);
+}
+
+static void set_rrpv(Pcache c, unsigned index, int line, unsigned long long rrpv)
+{
+  int shift = 2 * WAY(c, index, line);
+
+  c->repl[index] = (c->repl[index] & ~(3ULL << shift)) | (rrpv << shift);
+}
+
+static void rrip_hit(Pcache c, unsigned index, int line)
+{
+  set_rrpv(c, index, line, RRPV_NEAR);
+}
+
+static void srrip_fill(Pcache c, unsigned index, int line)
+{
+  set_rrpv(c, index, line, RRPV_LONG);
+}
+
+static void brrip_fill(Pcache c, unsigned index, int line)
+{
+  set_rrpv(c, index, line, draw(c, index) % BRRIP_LONG_ONE_IN ? RRPV_DISTANT : RRPV_LONG);
+}
+
+/* Predictions below distant all age by one until one becomes distant,
+   which is at most three additions to the whole word */
+static int rrip_victim(Pcache c, unsigned index)
+{
+  unsigned long long ones = rrpv_ones(c), bits = c->repl[index], distant;
+
+  while (!(distant = bits & (bits >> 1) & ones))
+    bits += ones;
+  c->repl[index] = bits;
+  return index * c->associativity + __builtin_ctzll(distant) / 2;
+}
+
+static void no_update(Pcache c, unsigned index, int line)
+{
+  (void)c;
+  (void)index;
+  (void)line;
+}
+
+static int random_victim(Pcache c, unsigned index)
+{
+  return index * c->associativity + draw(c, index) % c->associativity;
+}
+/************************************************************/
+
+/************************************************************/
+const replacement replacements[N_REPL_POLICIES] = {
+  { "LRU", 255, touch, touch, lru_victim },
+  { "PLRU", 64, plru_touch, plru_touch, plru_victim },
+  { "NRU", 64, nru_touch, nru_touch, nru_victim },
+  { "SRRIP", 32, rrip_hit, srrip_fill, rrip_victim },
+  { "BRRIP", 32, rrip_hit, brrip_fill, rrip_victim },
+  { "random", 255, no_update, no_update, random_victim },
+};
+
+/* returns why policy cannot replace the lines of an assoc way set, NULL if
+   it can */
+char *repl_error(int assoc, int policy)
+{
+  static __thread char error_text[80];
+  const replacement *r = &replacements[policy];
+
+  if (assoc > r->max_assoc) {
+    snprintf(error_text, sizeof(error_text), "%s replacement supports at most %d ways",
+             r->name, r->max_assoc);
+    return error_text;
+  }
+  if (policy == REPL_PLRU && (assoc & (assoc - 1)))
+    return "PLRU replacement needs a power of two associativity";
+  return NULL;
+}
+
+/* sets up the replacement state of a private cache whose geometry is
+   already known */
+void repl_init(Pcache c, int policy)
+{
+  char *msg = repl_error(c->associativity, policy);
+  int i;
+
+  if (msg != NULL) {
+    printf("error : %s\n", msg);
+    exit(-1);
+  }
+  if (policy == REPL_PLRU)
+    pthread_once(&plru_once, build_plru_tables);
+
+  c->policy = policy;
+  c->repl = (unsigned long long *)calloc(c->n_sets, sizeof(unsigned long long));
+  c->seeds = (unsigned *)malloc(sizeof(unsigned) * c->n_sets);
+  if (c->repl == NULL || c->seeds == NULL) {
+    printf("error : Memory allocation failed for the replacement state\n");
+    exit(-1);
+  }
+  for (i = 0; i < c->n_sets; i++)
+    c->seeds[i] = (i + 1) * 2654435761u | 1;
+}
+
+/* returns the REPL_ policy for a name, -1 if unknown */
+int find_repl_policy(char *name)
+{
+  int p;
+
+  for (p = 0; p < N_REPL_POLICIES; p++)
+    if (!strcasecmp(name, replacements[p].name))
+      return p;
+  return -1;
+}
+/************************************************************/
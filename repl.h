@@ -0,0 +1,37 @@
+/* Replacement policies of the private caches. True LRU orders the lines of
+   a set by the ranks of cache.h. The other policies pack their state into
+   one 64 bit word per set, so a hit or a fill is a few mask operations
+   whatever the associativity:
+     PLRU    a binary tree of associativity - 1 bits, each pointing at the
+             half that holds the victim
+     NRU     a used bit per way, cleared for all but the last way to be
+             used once every way is used
+     SRRIP   a 2 bit re-reference prediction per way; hits predict near
+             (0), fills predict long (2) and the victim is a way predicted
+             distant (3), after ageing the whole set if there is none
+     BRRIP   SRRIP filling at distant, and at long once in 32 fills
+     random  any way
+   BRRIP and random draw from a small per set generator, so a run gives the
+   same result with any -j. */
+#define REPL_LRU 0
+#define REPL_PLRU 1
+#define REPL_NRU 2
+#define REPL_SRRIP 3
+#define REPL_BRRIP 4
+#define REPL_RANDOM 5
+#define N_REPL_POLICIES 6
+#define DEFAULT_REPL REPL_LRU
+
+typedef struct replacement_ {
+  char *name;
+  int max_assoc;		/* largest associativity the state word holds */
+  void (*hit)(Pcache c, unsigned index, int line);
+  void (*fill)(Pcache c, unsigned index, int line);
+  int (*victim)(Pcache c, unsigned index);	/* line to replace in a full set */
+} replacement;
+
+extern const replacement replacements[N_REPL_POLICIES];
+
+char *repl_error(int assoc, int policy);
+void repl_init(Pcache c, int policy);
+int find_repl_policy(char *name);
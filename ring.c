@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+
+#include "ring.h"
+
+/* spins briefly before giving up the processor while waiting on the
+   other side of a ring */
+#define RING_SPINS 64
+
+/************************************************************/
+void ring_init(Pring r, size_t slot_size)
+{
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+  r->slot_size = slot_size;
+  r->slots = (char *)malloc(slot_size * RING_SLOTS);
+  if (r->slots == NULL) {
+    printf("error : Memory allocation failed for ring buffer\n");
+    exit(-1);
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* waits for a free slot, returns it for the producer to fill */
+void *ring_reserve(Pring r)
+{
+  unsigned head, spins = 0;
+
+  head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  while (head - atomic_load_explicit(&r->tail, memory_order_acquire) == RING_SLOTS)
+    if (++spins % RING_SPINS == 0)
+      sched_yield();
+  return r->slots + (head & (RING_SLOTS - 1)) * r->slot_size;
+}
+
+void ring_commit(Pring r)
+{
+  atomic_store_explicit(&r->head,
+    atomic_load_explicit(&r->head, memory_order_relaxed) + 1, memory_order_release);
+}
+/************************************************************/
+
+/************************************************************/
+/* waits for a published slot, returns it for the consumer to read */
+void *ring_peek(Pring r)
+{
+  unsigned tail, spins = 0;
+
+  tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  while (atomic_load_explicit(&r->head, memory_order_acquire) == tail)
+    if (++spins % RING_SPINS == 0)
+      sched_yield();
+  return r->slots + (tail & (RING_SLOTS - 1)) * r->slot_size;
+}
+
+void ring_release(Pring r)
+{
+  atomic_store_explicit(&r->tail,
+    atomic_load_explicit(&r->tail, memory_order_relaxed) + 1, memory_order_release);
+}
+/************************************************************/
@@ -0,0 +1,25 @@
+#include <stdatomic.h>
+#include <stddef.h>
+
+/* Lock-free single producer, single consumer ring of fixed size slots.
+   The producer fills the slot returned by ring_reserve() and publishes it
+   with ring_commit(); the consumer reads the slot returned by ring_peek()
+   and hands it back with ring_release(). Slots are used in place, so no
+   data is copied through the ring. */
+#define RING_SLOTS 8		/* must be a power of two */
+#define CACHE_LINE 64
+
+typedef struct ring_ {
+  _Atomic unsigned head;	/* slots published, written by the producer */
+  char pad_head[CACHE_LINE - sizeof(unsigned)];
+  _Atomic unsigned tail;	/* slots released, written by the consumer */
+  char pad_tail[CACHE_LINE - sizeof(unsigned)];
+  size_t slot_size;
+  char *slots;
+} ring, *Pring;
+
+void ring_init(Pring r, size_t slot_size);
+void *ring_reserve(Pring r);
+void ring_commit(Pring r);
+void *ring_peek(Pring r);
+void ring_release(Pring r);
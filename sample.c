@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "cache.h"
+#include "main.h"
+#include "trace.h"
+#include "sample.h"
+
+static int unit_len, warmup_len, period_len;
+static int in_roi;
+static int phase = PHASE_MEASURE;	/* of the models, see set_phase() */
+static long long roi_refs;		/* references seen inside the ROI */
+static long long measured_refs;
+static int n_units;
+
+static Pcache_stat totals;		/* measured counters, reported by print_stats() */
+static Pcache_stat unit;		/* counters of the unit being measured */
+static Pcache_stat discard;		/* fast-forward and warm-up counters */
+static Pcache_stat current;
+
+static sample_sum miss_rate, broadcasts, copies_back;
+
+/************************************************************/
+/* samples unit of every period references; without a period every
+   reference inside the region of interest is measured */
+void sample_init(int unit_refs, int warmup, int period, int roi)
+{
+  int n = num_cores();
+
+  unit_len = unit_refs;
+  warmup_len = warmup;
+  period_len = period;
+  in_roi = !roi;
+
+  unit = (Pcache_stat)calloc(n, sizeof(cache_stat));
+  discard = (Pcache_stat)calloc(n, sizeof(cache_stat));
+  if (unit == NULL || discard == NULL) {
+    printf("error:  unable to allocate sampling statistics\n");
+    exit(-1);
+  }
+  totals = swap_stats(discard);
+  current = discard;
+}
+/************************************************************/
+
+/************************************************************/
+static void add_sample(sample_sum *s, double value)
+{
+  s->sum += value;
+  s->sum_sq += value * value;
+}
+
+/* folds the unit being measured into the totals and the estimators */
+static void end_unit()
+{
+  int i;
+  double accesses = 0, misses = 0, bcasts = 0, words = 0;
+
+  for (i = 0; i < num_cores(); i++) {
+    accesses += unit[i].accesses;
+    misses += unit[i].misses;
+    bcasts += unit[i].broadcasts;
+    words += unit[i].copies_back;
+  }
+  if (accesses == 0)
+    return;
+
+  add_sample(&miss_rate, misses / accesses);
+  add_sample(&broadcasts, 1000.0 * bcasts / accesses);
+  add_sample(&copies_back, 1000.0 * words / accesses);
+  measured_refs += accesses;
+  n_units++;
+
+  add_stats(totals, unit);
+  memset(unit, 0, num_cores() * sizeof(cache_stat));
+}
+/************************************************************/
+
+/************************************************************/
+void sample_play(trace_record *rec, int n)
+{
+  int i, at, next;
+  Pcache_stat want;
+
+  for (i = 0; i < n; i++) {
+    switch (rec[i].access_type) {
+      case TRACE_ROI_BEGIN:
+        in_roi = TRUE;
+        continue;
+      case TRACE_ROI_END:
+        if (in_roi)
+          end_unit();
+        in_roi = FALSE;
+        continue;
+      case TRACE_LOAD:
+      case TRACE_STORE:
+        break;
+      default:
+        continue;
+    }
+
+    /* the unit ends each period, the warm-up window comes just before it
+       and the rest of the period is fast-forwarded */
+    want = discard;
+    next = PHASE_FAST_FORWARD;
+    if (in_roi) {
+      at = period_len ? roi_refs % period_len : 0;
+      if (at >= period_len - unit_len) {
+        want = unit;
+        next = PHASE_MEASURE;
+      } else if (at >= period_len - unit_len - warmup_len)
+        next = PHASE_WARM_UP;
+    }
+    if (want != current) {
+      swap_stats(want);
+      current = want;
+    }
+    if (next != phase) {
+      set_phase(next);
+      phase = next;
+    }
+
+    perform_access(rec[i].addr, rec[i].access_type, rec[i].pid);
+
+    if (in_roi && period_len && ++roi_refs % period_len == 0)
+      end_unit();
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* closes a partly measured unit; later accesses, such as the final flush,
+   are not counted */
+void sample_finish()
+{
+  end_unit();
+  swap_stats(discard);
+  current = discard;
+  set_phase(PHASE_MEASURE);
+  phase = PHASE_MEASURE;
+}
+/************************************************************/
+
+/************************************************************/
+static void print_estimate(char *name, sample_sum *s)
+{
+  double mean, var;
+
+  mean = s->sum / n_units;
+  if (n_units < 2) {
+    printf("  %-22s%f\n", name, mean);
+    return;
+  }
+  var = (s->sum_sq - n_units * mean * mean) / (n_units - 1);
+  if (var < 0)
+    var = 0;
+  printf("  %-22s%f +- %f\n", name, mean, SAMPLE_Z * sqrt(var / n_units));
+}
+
+/* directs the reports to the measured counters */
+void sample_totals()
+{
+  swap_stats(totals);
+}
+
+/* prints the measured statistics followed by the per unit estimates */
+void sample_report()
+{
+  sample_totals();
+  print_stats();
+
+  printf("\n");
+  printf("  SAMPLING\n");
+  printf("  units measured:       %d (%lld references)\n", n_units, measured_refs);
+  if (n_units == 0)
+    return;
+  if (n_units < 2)
+    printf("  (one unit, no confidence interval)\n");
+  print_estimate("miss rate:", &miss_rate);
+  print_estimate("broadcasts/1k refs:", &broadcasts);
+  print_estimate("copies back/1k refs:", &copies_back);
+}
+/************************************************************/
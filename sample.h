@@ -0,0 +1,20 @@
+/* Sampled simulation in the style of SMARTS: the trace is divided into
+   periods, each ending in a warm-up window whose statistics are discarded
+   and a measurement unit whose statistics are kept. References before the
+   warm-up are fast-forwarded, keeping the tag stores and coherence state
+   of every level warm but not the timing, classification and hot block
+   models (see set_phase()), which the warm-up window brings back.
+   Region-of-interest markers restrict measurement to the references
+   between TRACE_ROI_BEGIN and TRACE_ROI_END; the rest are fast-forwarded. */
+#define SAMPLE_Z 1.96		/* normal quantile for 95% confidence */
+
+typedef struct sample_sum_ {
+  double sum;			/* sum of the per unit values */
+  double sum_sq;		/* sum of their squares */
+} sample_sum;
+
+void sample_init(int unit, int warmup, int period, int roi);
+void sample_play(trace_record *rec, int n);
+void sample_finish();
+void sample_totals();
+void sample_report();
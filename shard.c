@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "cache.h"
+#include "main.h"
+#include "trace.h"
+#include "ring.h"
+#include "shard.h"
+#include "prof.h"
+
+typedef struct shard_ {
+  pthread_t thread;
+  ring queue;			/* batches routed to this shard */
+  shard_batch *fill;		/* batch being filled by the front end */
+  cache_context ctx;		/* tag store view, stats and snoop filter */
+} shard, *Pshard;
+
+static shard shards[MAX_SHARDS];
+static int n_shards;
+static int sets;
+
+/************************************************************/
+static void *shard_worker(void *arg)
+{
+  Pshard s = (Pshard)arg;
+  shard_batch *b;
+  int i;
+
+  load_context(&s->ctx);
+  for (;;) {
+    b = (shard_batch *)ring_peek(&s->queue);
+    if (b->n < 0)
+      break;
+    for (i = 0; i < b->n; i++)
+      perform_access(b->rec[i].addr, b->rec[i].access_type, b->rec[i].pid);
+    ring_release(&s->queue);
+  }
+  save_context(&s->ctx);
+  prof_flush();
+  return NULL;
+}
+/************************************************************/
+
+/************************************************************/
+/* splits the current cache model into n_threads shards and starts them */
+void shard_start(int n_threads)
+{
+  int k, shard_sets;
+
+  sets = num_sets();
+  n_shards = n_threads < sets ? n_threads : sets;
+  shard_sets = (sets + n_shards - 1) / n_shards;
+
+  for (k = 0; k < n_shards; k++) {
+    split_context(&shards[k].ctx, shard_sets);
+    ring_init(&shards[k].queue, sizeof(shard_batch));
+    shards[k].fill = (shard_batch *)ring_reserve(&shards[k].queue);
+    shards[k].fill->n = 0;
+    if (pthread_create(&shards[k].thread, NULL, shard_worker, &shards[k])) {
+      printf("error : Unable to start shard thread %d\n", k);
+      exit(-1);
+    }
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* routes each load and store to the shard owning its set */
+void shard_play(trace_record *rec, int n)
+{
+  Pshard s;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if (rec[i].access_type != TRACE_LOAD && rec[i].access_type != TRACE_STORE)
+      continue;
+
+    s = &shards[(unsigned long long)set_index(rec[i].addr) * n_shards / sets];
+    s->fill->rec[s->fill->n++] = rec[i];
+    if (s->fill->n == SHARD_BATCH) {
+      ring_commit(&s->queue);
+      s->fill = (shard_batch *)ring_reserve(&s->queue);
+      s->fill->n = 0;
+    }
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* drains every shard and merges its statistics into the current model */
+void shard_finish()
+{
+  int k;
+
+  for (k = 0; k < n_shards; k++) {
+    if (shards[k].fill->n > 0) {
+      ring_commit(&shards[k].queue);
+      shards[k].fill = (shard_batch *)ring_reserve(&shards[k].queue);
+    }
+    shards[k].fill->n = -1;
+    ring_commit(&shards[k].queue);
+  }
+
+  for (k = 0; k < n_shards; k++) {
+    pthread_join(shards[k].thread, NULL);
+    merge_context(&shards[k].ctx);
+  }
+}
+/************************************************************/
@@ -0,0 +1,15 @@
+/* Parallel engine: the set index space is split into contiguous ranges,
+   one per worker thread, and each reference is routed to the worker that
+   owns its set. Within a shard references keep their trace order, so the
+   merged statistics match the serial engine exactly. */
+#define MAX_SHARDS 64
+#define SHARD_BATCH 4096	/* references per ring slot */
+
+typedef struct shard_batch_ {
+  int n;			/* number of records, -1 to stop the worker */
+  trace_record rec[SHARD_BATCH];
+} shard_batch;
+
+void shard_start(int n_threads);
+void shard_play(trace_record *rec, int n);
+void shard_finish();
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+
+#include "cache.h"
+#include "stats.h"
+
+typedef struct stat_field_ {
+  char *name;
+  size_t offset;
+} stat_field;
+
+#define FIELD(f) { #f, offsetof(cache_stat, f) }
+
+static stat_field fields[] = {
+  FIELD(accesses), FIELD(misses), FIELD(replacements), FIELD(demand_fetches),
+  FIELD(copies_back), FIELD(fetches_from_memory), FIELD(broadcasts),
+  FIELD(read_requests), FIELD(write_requests), FIELD(snoops), FIELD(snoops_wasted),
+  FIELD(l2_accesses), FIELD(l2_misses), FIELD(llc_accesses), FIELD(llc_misses),
+  FIELD(dram_fetches), FIELD(dram_copies_back), FIELD(back_invalidations),
+  FIELD(cycles), FIELD(bus_wait), FIELD(compulsory_misses), FIELD(capacity_misses),
+  FIELD(conflict_misses), FIELD(true_sharing_misses), FIELD(false_sharing_misses),
+  FIELD(prefetches), FIELD(prefetch_hits), FIELD(prefetch_late),
+  FIELD(prefetch_invalidated), FIELD(prefetch_distance), FIELD(prefetch_fetches),
+  FIELD(prefetch_broadcasts), FIELD(write_throughs), FIELD(write_words),
+  FIELD(write_transactions)
+};
+#define N_FIELDS ((int)(sizeof(fields) / sizeof(fields[0])))
+
+#define VALUE(st, k) (*(long long *)((char *)(st) + fields[k].offset))
+
+static char *format_names[] = { "text", "json", "csv" };
+
+static FILE *interval_file;
+static Pcache_stat last;		/* counters at the end of the last interval */
+static long long last_references;
+
+/************************************************************/
+int find_stats_format(char *name)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+    if (!strcasecmp(name, format_names[i]))
+      return i;
+  return -1;
+}
+
+/* sums the counters of every core into total */
+void total_stats(Pcache_stat total)
+{
+  int i, k;
+
+  memset(total, 0, sizeof(cache_stat));
+  for (i = 0; i < num_cores(); i++)
+    for (k = 0; k < N_FIELDS; k++)
+      VALUE(total, k) += VALUE(core_stats(i), k);
+}
+
+static void json_counters(FILE *f, Pcache_stat st)
+{
+  int k;
+
+  for (k = 0; k < N_FIELDS; k++)
+    fprintf(f, "\"%s\": %lld, ", fields[k].name, VALUE(st, k));
+  fprintf(f, "\"miss_rate\": %f}", st->accesses ? (double)st->misses / st->accesses : 0.0);
+}
+
+static void csv_counters(FILE *f, Pcache_stat st)
+{
+  int k;
+
+  for (k = 0; k < N_FIELDS; k++)
+    fprintf(f, ",%lld", VALUE(st, k));
+  fprintf(f, ",%f\n", st->accesses ? (double)st->misses / st->accesses : 0.0);
+}
+/************************************************************/
+
+/************************************************************/
+void stats_begin(FILE *f, int format)
+{
+  int k;
+
+  if (format == STATS_JSON)
+    fprintf(f, "{\"configs\": [\n");
+  else {
+    fprintf(f, "size,assoc,block,protocol,repl,core");
+    for (k = 0; k < N_FIELDS; k++)
+      fprintf(f, ",%s", fields[k].name);
+    fprintf(f, ",miss_rate\n");
+  }
+}
+
+/* writes every core's counters of the current configuration and their
+   total */
+void stats_config(FILE *f, int format, int first)
+{
+  int i, usize, assoc, block_size;
+  char *protocol, *repl;
+  cache_stat total;
+
+  current_config(&usize, &assoc, &block_size, &protocol, &repl);
+  total_stats(&total);
+
+  if (format == STATS_JSON) {
+    fprintf(f, "%s  {\"size\": %d, \"assoc\": %d, \"block\": %d, \"protocol\": \"%s\", \"repl\": \"%s\", \"num_core\": %d,\n",
+            first ? "" : ",\n", usize, assoc, block_size, protocol, repl, num_cores());
+    fprintf(f, "   \"cores\": [\n");
+    for (i = 0; i < num_cores(); i++) {
+      fprintf(f, "    {\"core\": %d, ", i);
+      json_counters(f, core_stats(i));
+      fprintf(f, "%s\n", i < num_cores() - 1 ? "," : "");
+    }
+    fprintf(f, "   ],\n   \"total\": {");
+    json_counters(f, &total);
+    fprintf(f, "}");
+  } else {
+    for (i = 0; i < num_cores(); i++) {
+      fprintf(f, "%d,%d,%d,%s,%s,%d", usize, assoc, block_size, protocol, repl, i);
+      csv_counters(f, core_stats(i));
+    }
+    fprintf(f, "%d,%d,%d,%s,%s,total", usize, assoc, block_size, protocol, repl);
+    csv_counters(f, &total);
+  }
+}
+
+void stats_end(FILE *f, int format)
+{
+  if (format == STATS_JSON)
+    fprintf(f, "\n]}\n");
+}
+/************************************************************/
+
+/************************************************************/
+/* Interval time series: one row per core and interval, holding the
+   change of every counter since the previous interval. The first interval
+   starts at references, where the counters may not be zero after a
+   restore. */
+void interval_init(char *file, long long references)
+{
+  int i, k;
+
+  interval_file = fopen(file, "w");
+  last = (Pcache_stat)calloc(num_cores(), sizeof(cache_stat));
+  if (interval_file == NULL || last == NULL) {
+    printf("error : Unable to create interval file %s\n", file);
+    exit(-1);
+  }
+  for (i = 0; i < num_cores(); i++)
+    last[i] = *core_stats(i);
+  last_references = references;
+  fprintf(interval_file, "references,core");
+  for (k = 0; k < N_FIELDS; k++)
+    fprintf(interval_file, ",%s", fields[k].name);
+  fprintf(interval_file, ",miss_rate\n");
+}
+
+/* ends the interval at references */
+void interval_write(long long references)
+{
+  int i, k;
+  cache_stat delta;
+  Pcache_stat st;
+
+  if (references == last_references)
+    return;
+  for (i = 0; i < num_cores(); i++) {
+    st = core_stats(i);
+    for (k = 0; k < N_FIELDS; k++)
+      VALUE(&delta, k) = VALUE(st, k) - VALUE(&last[i], k);
+    last[i] = *st;
+    fprintf(interval_file, "%lld,%d", references, i);
+    csv_counters(interval_file, &delta);
+  }
+  last_references = references;
+}
+
+void interval_finish()
+{
+  if (fclose(interval_file) != 0) {
+    printf("error : Write to the interval file failed\n");
+    exit(-1);
+  }
+}
+/************************************************************/
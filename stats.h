@@ -0,0 +1,19 @@
+/* Machine readable statistics: the final counters of every configuration
+   as JSON or CSV, and a CSV time series of each core's counter deltas over
+   fixed intervals of references. Every cache_stat counter is written,
+   whether or not the feature that fills it is enabled, so the columns do
+   not change from run to run. */
+#define STATS_TEXT 0
+#define STATS_JSON 1
+#define STATS_CSV 2
+
+#define DEFAULT_INTERVAL_FILE "intervals.csv"
+
+int find_stats_format(char *name);
+void stats_begin(FILE *f, int format);
+void stats_config(FILE *f, int format, int first);
+void stats_end(FILE *f, int format);
+void total_stats(Pcache_stat total);
+void interval_init(char *file, long long references);
+void interval_write(long long references);
+void interval_finish();
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "timing.h"
+
+/* Per thread, like the model of cache.c; see timing_save() */
+static __thread int lat_hit = DEFAULT_LAT_HIT, lat_c2c = DEFAULT_LAT_C2C;
+static __thread int lat_mem = DEFAULT_LAT_MEM, lat_l2 = DEFAULT_LAT_L2;
+static __thread int lat_llc = DEFAULT_LAT_LLC;
+static __thread int bus_arb = DEFAULT_BUS_ARB;
+static __thread int data_cycles;		/* bus cycles to move one block */
+static __thread int bus_bytes;			/* bytes per bus cycle */
+static __thread int num_core;
+
+static __thread long long *core_time;		/* cycle each core's next reference issues */
+static __thread long long issued;		/* issue cycle of the latest reference */
+static __thread long long now;			/* progress of the reference being timed */
+static __thread long long *slot_start, *slot_end;	/* bus reservations, in order */
+static __thread int n_slots, max_slots;
+static __thread long long bus_busy;		/* cycles the bus was held */
+static __thread long long bus_transactions;
+static __thread long long bus_wait;		/* cycles spent waiting for the bus */
+static __thread long long access_wait;		/* of which by the reference being timed */
+static __thread int prefetching;		/* the phases being timed belong to a prefetch */
+static __thread long long demand_now;		/* progress of the reference that issued it */
+static __thread int paused;			/* a sampled run is fast-forwarding */
+
+/************************************************************/
+/* lat holds the hit, cache to cache, memory, L2 and LLC latencies; trailing
+   ones may be left out */
+void timing_init(int *lat, int n_lat, int bus_width, int arb, int block_size,
+                 int n_cores)
+{
+  int *dst[5] = { &lat_hit, &lat_c2c, &lat_mem, &lat_l2, &lat_llc };
+  int i;
+
+  for (i = 0; i < n_lat && i < 5; i++)
+    *dst[i] = lat[i];
+  bus_arb = arb;
+  data_cycles = (block_size + bus_width - 1) / bus_width;
+  bus_bytes = bus_width;
+  num_core = n_cores;
+  issued = now = demand_now = 0;
+  n_slots = 0;
+  bus_busy = bus_transactions = bus_wait = access_wait = 0;
+  prefetching = paused = FALSE;
+
+  max_slots = 4 * n_cores;
+  core_time = (long long *)calloc(n_cores, sizeof(long long));
+  slot_start = (long long *)malloc(max_slots * sizeof(long long));
+  slot_end = (long long *)malloc(max_slots * sizeof(long long));
+  if (core_time == NULL || slot_start == NULL || slot_end == NULL) {
+    printf("error : Memory allocation failed for the core clocks\n");
+    exit(-1);
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* reserves the bus for the first gap of cycles at or after t, returns when
+   it is released. Later phases of a transaction are reserved ahead of time,
+   so a request may still slip in before them. */
+static long long bus_use(long long t, int cycles, int on_path)
+{
+  long long start = t;
+  int len = bus_arb + cycles;
+  int i;
+
+  for (i = 0; i < n_slots; i++) {
+    if (slot_end[i] <= start)
+      continue;
+    if (slot_start[i] >= start + len)
+      break;
+    start = slot_end[i];
+  }
+
+  if (n_slots == max_slots) {
+    max_slots *= 2;
+    slot_start = (long long *)realloc(slot_start, max_slots * sizeof(long long));
+    slot_end = (long long *)realloc(slot_end, max_slots * sizeof(long long));
+    if (slot_start == NULL || slot_end == NULL) {
+      printf("error : Memory allocation failed for the bus reservations\n");
+      exit(-1);
+    }
+  }
+  memmove(slot_start + i + 1, slot_start + i, (n_slots - i) * sizeof(long long));
+  memmove(slot_end + i + 1, slot_end + i, (n_slots - i) * sizeof(long long));
+  slot_start[i] = start;
+  slot_end[i] = start + len;
+  n_slots++;
+
+  bus_wait += start - t;
+  if (on_path)
+    access_wait += start - t;
+  bus_busy += len;
+  bus_transactions++;
+  return start + len;
+}
+
+/* the trace orders the references, so none issues before its predecessor */
+void timing_begin(unsigned pid)
+{
+  int i;
+
+  if (core_time[pid] > issued)
+    issued = core_time[pid];
+  now = issued + lat_hit;
+
+  /* no later request can use the bus before issued */
+  for (i = 0; i < n_slots && slot_end[i] <= issued; i++)
+    ;
+  if (i) {
+    n_slots -= i;
+    memmove(slot_start, slot_start + i, n_slots * sizeof(long long));
+    memmove(slot_end, slot_end + i, n_slots * sizeof(long long));
+  }
+  access_wait = 0;
+}
+
+/* the address phase of a broadcast */
+void timing_broadcast()
+{
+  now = bus_use(now, 1, !prefetching);
+}
+
+/* a missing block arrives from source, one of the FILL_ levels */
+void timing_fill(int source)
+{
+  switch (source) {
+    case FILL_PEER:
+      now = bus_use(now + lat_c2c, data_cycles, !prefetching);
+      break;
+    case FILL_L2:
+      now += lat_l2;
+      break;
+    case FILL_LLC:
+      now = bus_use(now + lat_llc, data_cycles, !prefetching);
+      break;
+    case FILL_DRAM:
+      now = bus_use(now + lat_mem, data_cycles, !prefetching);
+      break;
+  }
+}
+
+/* write backs are buffered, they hold the bus without stalling the core */
+void timing_write_back()
+{
+  bus_use(now, data_cycles, FALSE);
+}
+
+/* stores written through or around the cache move words to memory. Without
+   a write buffer the core waits until the bus takes them. */
+void timing_write_through(int words, int stall)
+{
+  long long end;
+
+  if (paused)
+    return;
+  end = bus_use(now, (words * WORD_SIZE + bus_bytes - 1) / bus_bytes, stall);
+  if (stall)
+    now = end;
+}
+
+/* A prefetch issues once the reference that triggered it is done and
+   holds the bus like any request, but the reference does not wait for it */
+void timing_prefetch_begin()
+{
+  demand_now = now;
+  prefetching = TRUE;
+}
+
+/* returns the cycle the prefetched block arrives */
+long long timing_prefetch_end()
+{
+  long long ready = now;
+
+  now = demand_now;
+  prefetching = FALSE;
+  return ready;
+}
+
+/* a reference that hits a line still being prefetched waits for the fill,
+   returns TRUE if it had to */
+int timing_wait(long long ready)
+{
+  if (paused || ready <= now)
+    return FALSE;
+  now = ready;
+  return TRUE;
+}
+
+/* While a sampled run fast-forwards, the clocks stand still and the write
+   buffers and prefetchers, which keep running, leave the bus alone */
+void timing_pause(int pause)
+{
+  paused = pause;
+}
+
+void timing_end(unsigned pid)
+{
+  Pcache_stat st = core_stats(pid);
+
+  st->cycles += now - issued;
+  st->bus_wait += access_wait;
+  core_time[pid] = now;
+}
+/************************************************************/
+
+/************************************************************/
+void print_timing_stats()
+{
+  int i;
+  long long elapsed = 0;
+  Pcache_stat st;
+
+  for (i = 0; i < num_core; i++)
+    if (core_time[i] > elapsed)
+      elapsed = core_time[i];
+  if (n_slots && slot_end[n_slots-1] > elapsed)
+    elapsed = slot_end[n_slots-1];
+
+  printf("\n");
+  printf("  TIMING\n");
+  for (i = 0; i < num_core; i++) {
+    st = core_stats(i);
+    printf("  CORE %d AMAT:          %f cycles (bus wait %f)\n", i,
+           st->accesses ? (double)st->cycles / st->accesses : 0.0,
+           st->accesses ? (double)st->bus_wait / st->accesses : 0.0);
+  }
+  printf("  elapsed cycles:       %lld\n", elapsed);
+  printf("  bus transactions:     %lld\n", bus_transactions);
+  printf("  bus utilization:      %f\n",
+         elapsed ? (double)bus_busy / elapsed : 0.0);
+  printf("  queueing delay:       %f cycles per transaction\n",
+         bus_transactions ? (double)bus_wait / bus_transactions : 0.0);
+}
+/************************************************************/
+
+/************************************************************/
+/* copies the model of this thread into ctx, timing_load() puts it back */
+void timing_save(timing_context *ctx)
+{
+  ctx->lat_hit = lat_hit;
+  ctx->lat_c2c = lat_c2c;
+  ctx->lat_mem = lat_mem;
+  ctx->lat_l2 = lat_l2;
+  ctx->lat_llc = lat_llc;
+  ctx->bus_arb = bus_arb;
+  ctx->data_cycles = data_cycles;
+  ctx->bus_bytes = bus_bytes;
+  ctx->num_core = num_core;
+  ctx->core_time = core_time;
+  ctx->issued = issued;
+  ctx->now = now;
+  ctx->slot_start = slot_start;
+  ctx->slot_end = slot_end;
+  ctx->n_slots = n_slots;
+  ctx->max_slots = max_slots;
+  ctx->bus_busy = bus_busy;
+  ctx->bus_transactions = bus_transactions;
+  ctx->bus_wait = bus_wait;
+  ctx->access_wait = access_wait;
+  ctx->prefetching = prefetching;
+  ctx->demand_now = demand_now;
+  ctx->paused = paused;
+}
+
+void timing_load(timing_context *ctx)
+{
+  lat_hit = ctx->lat_hit;
+  lat_c2c = ctx->lat_c2c;
+  lat_mem = ctx->lat_mem;
+  lat_l2 = ctx->lat_l2;
+  lat_llc = ctx->lat_llc;
+  bus_arb = ctx->bus_arb;
+  data_cycles = ctx->data_cycles;
+  bus_bytes = ctx->bus_bytes;
+  num_core = ctx->num_core;
+  core_time = ctx->core_time;
+  issued = ctx->issued;
+  now = ctx->now;
+  slot_start = ctx->slot_start;
+  slot_end = ctx->slot_end;
+  n_slots = ctx->n_slots;
+  max_slots = ctx->max_slots;
+  bus_busy = ctx->bus_busy;
+  bus_transactions = ctx->bus_transactions;
+  bus_wait = ctx->bus_wait;
+  access_wait = ctx->access_wait;
+  prefetching = ctx->prefetching;
+  demand_now = ctx->demand_now;
+  paused = ctx->paused;
+}
+
+void timing_free(timing_context *ctx)
+{
+  free(ctx->core_time);
+  free(ctx->slot_start);
+  free(ctx->slot_end);
+}
+/************************************************************/
@@ -0,0 +1,44 @@
+/* Optional timing layer. Every core has its own clock and issues its next
+   reference once the previous one completes, but never ahead of the
+   reference before it in the trace. Broadcasts, cache to cache
+   transfers, fills from the shared levels, write backs and stores written
+   through to memory occupy a single shared bus. Each phase takes the first
+   free gap at or after the cycle it is ready, in trace order, plus a fixed
+   arbitration delay, so a busy bus delays the requests of every core. */
+#define DEFAULT_LAT_HIT 1
+#define DEFAULT_LAT_C2C 20
+#define DEFAULT_LAT_MEM 100
+#define DEFAULT_LAT_L2 10
+#define DEFAULT_LAT_LLC 30
+#define DEFAULT_BUS_WIDTH 8	/* bytes per bus cycle */
+#define DEFAULT_BUS_ARB 1	/* arbitration cycles per transaction */
+
+/* the model of one cache_context, see save_context() */
+typedef struct timing_context_ {
+  int lat_hit, lat_c2c, lat_mem, lat_l2, lat_llc;
+  int bus_arb, data_cycles, bus_bytes, num_core;
+  long long *core_time, issued, now;
+  long long *slot_start, *slot_end;
+  int n_slots, max_slots;
+  long long bus_busy, bus_transactions, bus_wait, access_wait;
+  int prefetching;
+  long long demand_now;
+  int paused;
+} timing_context;
+
+void timing_init(int *lat, int n_lat, int bus_width, int bus_arb, int block_size,
+                 int n_cores);
+void timing_begin(unsigned pid);
+void timing_broadcast();
+void timing_fill(int source);
+void timing_write_back();
+void timing_write_through(int words, int stall);
+void timing_prefetch_begin();
+long long timing_prefetch_end();
+int timing_wait(long long ready);
+void timing_pause(int pause);
+void timing_end(unsigned pid);
+void print_timing_stats();
+void timing_save(timing_context *ctx);
+void timing_load(timing_context *ctx);
+void timing_free(timing_context *ctx);
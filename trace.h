@@ -0,0 +1,31 @@
+#include <stdint.h>
+
+/* Binary trace format: a trace_header followed by fixed-width
+   trace_records in native byte order. Produced from text traces by
+   validate/tracebin and read by the simulator through mmap. */
+#define TRACE_MAGIC "CA4TRACE"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_VERSION 2
+
+typedef struct trace_header_ {
+  char magic[TRACE_MAGIC_SIZE];	/* TRACE_MAGIC, not NUL terminated */
+  uint32_t version;		/* TRACE_VERSION */
+  uint32_t record_size;		/* sizeof(trace_record) */
+} trace_header;
+
+typedef struct trace_record_ {
+  uint64_t addr;		/* referenced address */
+  uint16_t pid;			/* core issuing the reference */
+  uint8_t access_type;		/* TRACE_LOAD, TRACE_STORE, ... */
+  uint8_t reserved[5];
+} trace_record;
+
+/* version 1 traces held 32 bit addresses; the simulator still reads them */
+#define TRACE_VERSION_32 1
+
+typedef struct trace_record_32_ {
+  uint32_t addr;
+  uint16_t pid;
+  uint8_t access_type;
+  uint8_t reserved;
+} trace_record_32;
@@ -5,7 +5,7 @@
 
 main()
 {
-   int read_trace_element(FILE *inFile, unsigned *access_type, unsigned *addr);
+   int read_trace_element(FILE *inFile, unsigned *access_type, unsigned long long *addr);
 
    FILE *input, *output;
    input = fopen("tex.trace", "r");
@@ -14,12 +14,13 @@ main()
    int result;
    char c;
    int coreId = 7;
-   unsigned access_type, addr;
+   unsigned access_type;
+   unsigned long long addr;
    
    while(read_trace_element(input, &access_type, &addr))
    {
       if(access_type == 2) access_type = 0;
-      fprintf(output, "%d %d %x\n", coreId, access_type, addr);
+      fprintf(output, "%d %d %llx\n", coreId, access_type, addr);
    }
    
   fclose(input);
@@ -28,12 +29,12 @@ main()
 
 
 /************************************************************/
-int read_trace_element(FILE *inFile, unsigned *access_type, unsigned *addr)
+int read_trace_element(FILE *inFile, unsigned *access_type, unsigned long long *addr)
 {
   int result;
   char c;
 
-  result = fscanf(inFile, "%u %x%c", access_type, addr, &c);
+  result = fscanf(inFile, "%u %llx%c", access_type, addr, &c);
   while (c != '\n') {
     result = fscanf(inFile, "%c", &c);
     if (result == EOF)
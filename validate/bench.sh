@@ -0,0 +1,31 @@
+#!/bin/sh
+# Throughput suite run by "make bench": simulates each synthetic pattern
+# and reports references per second, peak RSS and the final traffic stats,
+# then replays it again with -nobatch to compare the batched replay with
+# one reference at a time.
+# Traces are generated once into bench/ and reused while their parameters
+# stay the same.
+#   BENCH_CORES  simulated cores (default 16)
+#   BENCH_REFS   references per trace (default 5000000)
+#   BENCH_FOOTPRINT  bytes per trace region (default 16384)
+#   BENCH_FLAGS  cache options passed to sim
+
+CORES=${BENCH_CORES:-16}
+REFS=${BENCH_REFS:-5000000}
+FOOTPRINT=${BENCH_FOOTPRINT:-16384}
+FLAGS=${BENCH_FLAGS:--sf -us 32768 -a 8 -bs 64}
+DIR=bench
+
+mkdir -p $DIR || exit 1
+for p in stream random prodcons falseshare migratory readmostly mixed; do
+  trace=$DIR/$p-n$CORES-r$REFS-f$FOOTPRINT.bin
+  [ -f $trace ] || ./gentrace -p $p -n $CORES -r $REFS -f $FOOTPRINT $trace || exit 1
+  echo "=== $p: $CORES cores, $REFS references, $FOOTPRINT byte regions, $FLAGS"
+  ./sim -n $CORES $FLAGS -bench $trace > $DIR/batched.out || exit 1
+  ./sim -n $CORES $FLAGS -nobatch -bench $trace > $DIR/single.out || exit 1
+  sed -n '/TRAFFIC/,$p' $DIR/batched.out
+  awk '/bench:/ { rate[FILENAME] = $7 }
+       END { b = rate[ARGV[1]]; s = rate[ARGV[2]];
+             printf "  one at a time: %.0f references/s, batched %.2fx\n", s, (s > 0 ? b / s : 0) }' \
+    $DIR/batched.out $DIR/single.out
+done
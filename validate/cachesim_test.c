@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../cachesim.h"
+#include "../hier.h"
+#include "../prefetch.h"
+
+//Run by "make check". Drives cachesim handles holding every optional model
+//from several threads at once, two handles per thread taking turns over a
+//binary trace, then prints their reports in a fixed order. check.sh runs
+//sim with the options of "cachesim_test -list" and compares. Each model
+//is held by both handles of some thread, so a model one handle left in
+//the statics would show. The error codes of the library are checked on
+//the way.
+
+#define N_THREADS 4
+#define CHUNK 1000	//records fed to a handle before switching to the other
+
+typedef struct config_ {
+   char *options;		//the same configuration as sim options
+   int params[16][2];		//cachesim_set calls, ended by -1
+   int cores[2][5];		//cachesim_set_cores calls, ended by a 0 last core
+} config;
+
+static config configs[2 * N_THREADS] = {
+   {"-n 4 -us 2048 -a 4 -l2 16384 -llc 65536 -timing",
+    {{NUM_CORE, 4}, {CACHE_PARAM_USIZE, 2048}, {CACHE_PARAM_ASSOC, 4}, {PARAM_L2_USIZE, 16384},
+     {PARAM_LLC_USIZE, 65536}, {PARAM_TIMING, 1}, {-1}}, {{0}}},
+   {"-n 4 -us 2048 -a 4 -l2 8192 -l2a 4 -llc 65536 -llc-policy nine -prefetch stream -prefetch-degree 2 -timing -classify -hot 4",
+    {{NUM_CORE, 4}, {CACHE_PARAM_USIZE, 2048}, {CACHE_PARAM_ASSOC, 4}, {PARAM_L2_USIZE, 8192},
+     {PARAM_L2_ASSOC, 4}, {PARAM_LLC_USIZE, 65536}, {PARAM_LLC_POLICY, LLC_NINE},
+     {PARAM_PREFETCH, PREFETCH_STREAM}, {PARAM_PREFETCH_DEGREE, 2}, {PARAM_TIMING, 1},
+     {PARAM_CLASSIFY, 1}, {PARAM_HOT, 4}, {-1}}, {{0}}},
+   {"-n 4 -us 2048 -a 4 -timing -classify -hot 3",
+    {{NUM_CORE, 4}, {CACHE_PARAM_USIZE, 2048}, {CACHE_PARAM_ASSOC, 4}, {PARAM_TIMING, 1},
+     {PARAM_CLASSIFY, 1}, {PARAM_HOT, 3}, {-1}}, {{0}}},
+   {"-n 4 -us 4096 -a 8 -proto moesi -sf -repl plru -classify -hot 6",
+    {{NUM_CORE, 4}, {CACHE_PARAM_USIZE, 4096}, {CACHE_PARAM_ASSOC, 8}, {PARAM_PROTOCOL, PROTO_MOESI},
+     {PARAM_SNOOP_FILTER, 0}, {PARAM_REPL, REPL_PLRU}, {PARAM_CLASSIFY, 1},
+     {PARAM_HOT, 6}, {-1}}, {{0}}},
+   {"-n 4 -us 2048 -a 4 -wt -wbuf 4 -prefetch next -timing",
+    {{NUM_CORE, 4}, {CACHE_PARAM_USIZE, 2048}, {CACHE_PARAM_ASSOC, 4}, {CACHE_PARAM_WRITETHROUGH, 0},
+     {PARAM_WBUF, 4}, {PARAM_PREFETCH, PREFETCH_NEXT}, {PARAM_TIMING, 1}, {-1}}, {{0}}},
+   {"-n 4 -us 2048 -a 4 -nw -wbuf 2 -hot 5 -prefetch stride -lat 2,30,150 -bus 16,2",
+    {{NUM_CORE, 4}, {CACHE_PARAM_USIZE, 2048}, {CACHE_PARAM_ASSOC, 4}, {CACHE_PARAM_NOWRITEALLOC, 0},
+     {PARAM_WBUF, 2}, {PARAM_HOT, 5}, {PARAM_PREFETCH, PREFETCH_STRIDE}, {PARAM_TIMING, 1},
+     {PARAM_LAT_HIT, 2}, {PARAM_LAT_C2C, 30}, {PARAM_LAT_MEM, 150}, {PARAM_BUS_WIDTH, 16},
+     {PARAM_BUS_ARB, 2}, {-1}}, {{0}}},
+   {"-n 4 -us 1024 -a 2 -llc 32768 -llc-policy exclusive -prefetch stride -timing",
+    {{NUM_CORE, 4}, {CACHE_PARAM_USIZE, 1024}, {CACHE_PARAM_ASSOC, 2}, {PARAM_LLC_USIZE, 32768},
+     {PARAM_LLC_POLICY, LLC_EXCLUSIVE}, {PARAM_PREFETCH, PREFETCH_STRIDE}, {PARAM_TIMING, 1}, {-1}}, {{0}}},
+   {"-n 4 -cores 0-1:1024,2,16 -cores 2-3:4096,4,16 -proto mesif -repl srrip -timing",
+    {{NUM_CORE, 4}, {PARAM_PROTOCOL, PROTO_MESIF}, {PARAM_REPL, REPL_SRRIP}, {PARAM_TIMING, 1}, {-1}},
+    {{0, 1, 1024, 2, 16}, {2, 3, 4096, 4, 16}}},
+};
+
+static trace_record *records;
+static long n_records;
+static int failed;
+
+//the threads print their reports in turn
+static pthread_mutex_t turn_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t turn_done = PTHREAD_COND_INITIALIZER;
+static int turn;
+
+static void check(int result, int expected, Pcachesim sim, char *what)
+{
+   if(result != expected)
+   {
+      fprintf(stderr, "cachesim_test: %s returned %d, expected %d (%s)\n", what, result, expected,
+              result != CACHESIM_OK && sim != NULL ? cachesim_error(sim) : "");
+      failed = 1;
+   }
+}
+
+static Pcachesim build(config *c)
+{
+   Pcachesim sim = cachesim_create();
+   int i;
+
+   if(sim == NULL) {printf("error : Memory allocation failed\n"); exit(-1);}
+   for(i = 0; c->params[i][0] >= 0; i++)
+      check(cachesim_set(sim, c->params[i][0], c->params[i][1]), CACHESIM_OK, sim, c->options);
+   for(i = 0; i < 2 && c->cores[i][1] > 0; i++)
+      check(cachesim_set_cores(sim, c->cores[i][0], c->cores[i][1], c->cores[i][2], c->cores[i][3],
+                               c->cores[i][4]), CACHESIM_OK, sim, c->options);
+   return sim;
+}
+
+//feeds a chunk one reference at a time, skipping what a batch skips
+static void access_each(Pcachesim sim, trace_record *rec, int n)
+{
+   int i;
+
+   for(i = 0; i < n; i++)
+      if(IS_ACCESS(&rec[i]))
+         check(cachesim_access(sim, rec[i].addr, rec[i].access_type, rec[i].pid), CACHESIM_OK, sim, "cachesim_access");
+}
+
+static void *worker(void *arg)
+{
+   int t = (int)(long)arg, k, n;
+   Pcachesim sim[2];
+   long i;
+
+   sim[0] = build(&configs[2 * t]);
+   sim[1] = build(&configs[2 * t + 1]);
+
+   //Each handle takes its chunks alternately batched and one at a time
+   for(i = 0; i < n_records; i += CHUNK)
+   {
+      n = n_records - i < CHUNK ? n_records - i : CHUNK;
+      for(k = 0; k < 2; k++)
+      {
+         if((i / CHUNK + k) % 2)
+            access_each(sim[k], &records[i], n);
+         else
+            check(cachesim_access_batch(sim[k], &records[i], n), CACHESIM_OK, sim[k], "cachesim_access_batch");
+      }
+   }
+   for(k = 0; k < 2; k++)
+      check(cachesim_flush(sim[k]), CACHESIM_OK, sim[k], "cachesim_flush");
+
+   pthread_mutex_lock(&turn_lock);
+   while(turn != t)
+      pthread_cond_wait(&turn_done, &turn_lock);
+   for(k = 0; k < 2; k++)
+   {
+      printf("=== %s\n", configs[2 * t + k].options);
+      check(cachesim_print_stats(sim[k]), CACHESIM_OK, sim[k], "cachesim_print_stats");
+      check(cachesim_destroy(sim[k]), CACHESIM_OK, sim[k], "cachesim_destroy");
+   }
+   fflush(stdout);
+   turn++;
+   pthread_cond_broadcast(&turn_done);
+   pthread_mutex_unlock(&turn_lock);
+   return NULL;
+}
+
+static void *access_other(void *arg)
+{
+   Pcachesim sim = (Pcachesim)arg;
+
+   check(cachesim_access(sim, 0, DATA_LOAD_REFERENCE, 0), CACHESIM_OTHER_THREAD, sim, "access from another thread");
+   return NULL;
+}
+
+//every error code, and that a failed call leaves the handles usable
+static void check_errors()
+{
+   Pcachesim good = cachesim_create(), bad = cachesim_create(), far = cachesim_create();
+   trace_record rec[2];
+   cache_stat st;
+   pthread_t thread;
+
+   if(good == NULL || bad == NULL || far == NULL) {printf("error : Memory allocation failed\n"); exit(-1);}
+   check(cachesim_set(good, N_PARAMS, 1), CACHESIM_UNSUPPORTED, good, "unknown parameter");
+   check(cachesim_set(good, PARAM_REPL, 99), CACHESIM_BAD_VALUE, good, "unknown policy");
+   check(cachesim_set(good, PARAM_BUS_WIDTH, 0), CACHESIM_BAD_VALUE, good, "bus width 0");
+   check(cachesim_set_cores(good, 2, 1, 1024, 2, 16), CACHESIM_BAD_VALUE, good, "empty core group");
+   check(cachesim_set(good, NUM_CORE, 2), CACHESIM_OK, good, "core count");
+   check(cachesim_set(good, PARAM_TIMING, 1), CACHESIM_OK, good, "timing");
+   check(cachesim_access(good, 64, DATA_STORE_REFERENCE, 1), CACHESIM_OK, good, "first access");
+   check(cachesim_set(good, PARAM_HOT, 2), CACHESIM_BUILT, good, "parameter after an access");
+   check(cachesim_set_cores(good, 0, 1, 1024, 2, 16), CACHESIM_BUILT, good, "core group after an access");
+   check(cachesim_access(good, 64, DATA_LOAD_REFERENCE, 2), CACHESIM_BAD_CORE, good, "access to core 2 of 2");
+
+   //the lower levels do not model write through
+   cachesim_set(bad, PARAM_L2_USIZE, 16384);
+   cachesim_set(bad, CACHE_PARAM_WRITETHROUGH, 0);
+   check(cachesim_access(bad, 64, DATA_LOAD_REFERENCE, 0), CACHESIM_BAD_CONFIG, bad, "-l2 with -wt");
+   check(cachesim_flush(bad), CACHESIM_BAD_CONFIG, bad, "flush of a bad configuration");
+   cachesim_set(far, NUM_CORE, 2);
+   cachesim_set_cores(far, 0, 3, 1024, 2, 16);
+   check(cachesim_access(far, 64, DATA_LOAD_REFERENCE, 0), CACHESIM_BAD_CONFIG, far, "-cores past the last core");
+
+   memset(rec, 0, sizeof(rec));
+   rec[0].addr = 128;
+   rec[1].addr = 128;
+   rec[1].pid = 5;
+   check(cachesim_access_batch(good, rec, 2), CACHESIM_BAD_CORE, good, "batch naming core 5 of 2");
+   check(cachesim_stats(good, 2, &st), CACHESIM_BAD_CORE, good, "stats of core 2 of 2");
+   check(cachesim_access(good, 64, DATA_LOAD_REFERENCE, 0), CACHESIM_OK, good, "access after the failures");
+   check(cachesim_stats(good, -1, &st), CACHESIM_OK, good, "stats");
+   if(st.accesses != 2)
+   {
+      fprintf(stderr, "cachesim_test: %lld accesses counted, expected 2\n", st.accesses);
+      failed = 1;
+   }
+
+   pthread_create(&thread, NULL, access_other, good);
+   pthread_join(thread, NULL);
+
+   check(cachesim_destroy(good), CACHESIM_OK, good, "destroy");
+   check(cachesim_destroy(bad), CACHESIM_OK, NULL, "destroy of a bad configuration");
+   check(cachesim_destroy(far), CACHESIM_OK, NULL, "destroy of a bad configuration");
+}
+
+int main(int argc, char **argv)
+{
+   pthread_t threads[N_THREADS];
+   trace_header header;
+   FILE *f;
+   long t;
+
+   if(argc == 2 && !strcmp(argv[1], "-list"))
+   {
+      for(t = 0; t < 2 * N_THREADS; t++)
+         printf("%s\n", configs[t].options);
+      return 0;
+   }
+   if(argc != 2)
+   {
+      printf("usage:  cachesim_test <binary trace> | -list\n");
+      exit(-1);
+   }
+
+   f = fopen(argv[1], "rb");
+   if(f == NULL) {printf("error : Unable to open %s\n", argv[1]); exit(-1);}
+   if(fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, TRACE_MAGIC, TRACE_MAGIC_SIZE) ||
+      header.version != TRACE_VERSION || header.record_size != sizeof(trace_record))
+   {
+      printf("error : %s is not a version %d binary trace\n", argv[1], TRACE_VERSION);
+      exit(-1);
+   }
+   fseek(f, 0, SEEK_END);
+   n_records = (ftell(f) - (long)sizeof(header)) / sizeof(trace_record);
+   fseek(f, sizeof(header), SEEK_SET);
+   records = (trace_record *)malloc(n_records * sizeof(trace_record));
+   if(records == NULL || (long)fread(records, sizeof(trace_record), n_records, f) != n_records)
+   {
+      printf("error : Unable to read %s\n", argv[1]);
+      exit(-1);
+   }
+   fclose(f);
+
+   check_errors();
+   for(t = 0; t < N_THREADS; t++)
+      pthread_create(&threads[t], NULL, worker, (void *)t);
+   for(t = 0; t < N_THREADS; t++)
+      pthread_join(threads[t], NULL);
+   free(records);
+   return failed;
+}
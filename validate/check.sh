@@ -0,0 +1,207 @@
+#!/bin/sh
+# Regression suite run by "make check": simulates each trace in tests/ with
+# the options listed below and compares the output with the expected
+# tests/<name>.out. After an intended change of output, "sh
+# validate/check.sh -u" rewrites the expected files; review their diff
+# before committing them. A second list runs generated traces two ways
+# that must give the same results.
+
+OUT=${TMPDIR:-/tmp}/check.$$
+GEN=$OUT.traces
+update=
+[ "$1" = "-u" ] && update=1
+fail=0
+mkdir -p $GEN || exit 1
+
+# expect <name> <what ran>: $OUT must match tests/<name>.out
+expect() {
+  if [ "$update" ]; then
+    cp $OUT tests/$1.out
+    echo "wrote $1"
+  elif cmp -s $OUT tests/$1.out; then
+    echo "ok    $1"
+  else
+    echo "FAIL  $1: $2"
+    diff tests/$1.out $OUT | head -20
+    fail=1
+  fi
+}
+
+# run <name> <trace> <sim options>
+run() {
+  name=$1
+  trace=$2
+  shift 2
+  ./sim "$@" tests/$trace > $OUT 2>&1
+  expect $name "./sim $* tests/$trace"
+}
+
+# records <name> <trace> <sim options>: what -stats json or csv print on
+# stdout, without the progress lines that go to stderr
+records() {
+  name=$1
+  trace=$2
+  shift 2
+  ./sim "$@" tests/$trace > $OUT 2> /dev/null
+  expect $name "./sim $* tests/$trace"
+}
+
+# intervals <name> <trace> <sim options>: the -interval CSV file
+intervals() {
+  name=$1
+  trace=$2
+  shift 2
+  ./sim "$@" -interval-file $OUT tests/$trace > /dev/null 2>&1
+  expect $name "./sim $* -interval-file <f> tests/$trace"
+}
+
+# parses <name> <trace> <sim options>: stdout must hold nothing but the
+# -stats json or csv records, also with the runs that print progress
+parses() {
+  name=$1
+  trace=$2
+  shift 2
+  ./sim "$@" $trace > $OUT 2> /dev/null
+  case "$*" in
+  *json*)
+    if ! command -v python3 > /dev/null; then
+      echo "skip  $name: no python3 to parse the JSON"
+      return
+    fi
+    python3 -m json.tool < $OUT > /dev/null 2>&1;;
+  *)
+    awk -F, 'NR == 1 { n = NF } NF != n || NF < 2 { exit 1 }' $OUT;;
+  esac
+  if [ $? -eq 0 ] && [ -s $OUT ]; then
+    echo "ok    $name"
+  else
+    echo "FAIL  $name: ./sim $* $trace printed more than the records"
+    head -5 $OUT
+    fail=1
+  fi
+}
+
+# same <name> <trace> <options> <options> [<pattern>]: both runs must
+# accept their options and print the same, but for the lines matching the
+# extended regular expression <pattern>, which report how the two runs
+# differ
+same() {
+  name=$1
+  ./sim $3 $2 2>&1 | grep -Ev "${5:-^$}" > $OUT
+  ./sim $4 $2 2>&1 | grep -Ev "${5:-^$}" > $OUT.2
+  if grep -q '^error' $OUT $OUT.2; then
+    echo "FAIL  $name: ./sim $3 $2 or ./sim $4 $2 rejected its options"
+    grep -h '^error' $OUT $OUT.2 | head -2
+    fail=1
+  elif cmp -s $OUT $OUT.2; then
+    echo "ok    $name"
+  else
+    echo "FAIL  $name: ./sim $3 $2 and ./sim $4 $2 differ"
+    diff $OUT $OUT.2 | head -20
+    fail=1
+  fi
+}
+
+# restore <name> <trace> <reference> <options>: a run restored from the
+# checkpoint written after <reference> must print what a straight run prints
+restore() {
+  rm -f $GEN/ck.$3
+  ./sim $4 -ckpt $3 -ckpt-file $GEN/ck $2 > /dev/null 2>&1
+  if [ ! -f $GEN/ck.$3 ]; then
+    echo "FAIL  $1: ./sim $4 -ckpt $3 $2 wrote no checkpoint"
+    fail=1
+    return
+  fi
+  same $1 $2 "$4" "$4 -restore $GEN/ck.$3"
+}
+
+run sample sample.test -n 4 -sample 20,40,100 -roi
+run sample-timing sample.test -n 4 -timing -classify -sample 20,40,100
+run llc-inclusive llc.test -n 2 -us 256 -l2 512 -llc 2048 -llc-policy inclusive
+run llc-exclusive llc.test -n 2 -us 256 -l2 512 -llc 2048 -llc-policy exclusive
+run llc-nine llc.test -n 2 -us 256 -l2 512 -llc 2048 -llc-policy nine
+run classify classify.test -n 2 -us 64 -a 1 -classify
+run prefetch-next prefetch.test -n 2 -us 3000 -a 3 -prefetch next
+run prefetch-stride prefetch.test -n 2 -us 3000 -a 3 -prefetch stride
+run prefetch-stream prefetch.test -n 2 -us 3000 -a 3 -prefetch stream -prefetch-degree 4
+run write-wt write.test -n 2 -us 128 -wt
+run write-nw write.test -n 2 -us 128 -nw
+run write-wt-nw-wbuf write.test -n 2 -us 128 -wt -nw -wbuf 2
+run write-wt-wbuf-timing write.test -n 2 -us 128 -wt -wbuf 4 -timing
+run cores cores.test -n 4 -cores 0-1:1024,2,64 -cores 2-3:256,1,16
+run cores-sf-moesi cores.test -n 4 -cores 0-1:1024,2,64 -cores 2-3:256,1,16 -sf -proto moesi
+run proto-msi proto.test -n 4 -us 256 -a 2 -proto msi -hot 4
+run proto-msi-wt proto.test -n 4 -us 256 -a 2 -proto msi -wt -hot 4
+run proto-mesif proto.test -n 4 -us 256 -a 2 -proto mesif -hot 4
+run hot-3 hot.test -n 4 -us 1024 -a 2 -hot 3
+run hot-8 hot.test -n 4 -us 1024 -a 2 -hot 8
+run repl-plru repl-plru.test -n 1 -us 64 -a 4 -repl plru
+run repl-nru repl-nru.test -n 1 -us 64 -a 4 -repl nru
+run repl-srrip repl-srrip.test -n 1 -us 64 -a 4 -repl srrip
+run repl-brrip repl-brrip.test -n 1 -us 64 -a 4 -repl brrip
+run repl-random repl-random.test -n 1 -us 64 -a 4 -repl random
+records stats-json write.test -n 2 -us 128 -stats json
+records stats-csv write.test -n 2 -us 128 -stats csv
+records stats-csv-sweep write.test -n 2 -us 128,256 -a 1,2 -stats csv
+intervals interval write.test -n 2 -us 128 -interval 10
+
+# the serial reader skips the lines the pipelined parser skips
+same comments tests/comments.test "-n 2" "-n 2 -p 2" "pipeline|parse:|simulate:"
+
+# the sharer bitmaps of the snoop filter span several words past 64 cores
+./gentrace -n 96 -r 40000 -f 4096 $GEN/n96.bin > /dev/null || exit 1
+./gentrace -n 200 -r 40000 -f 2048 -s 40 $GEN/n200.bin > /dev/null || exit 1
+SF='Snoop filter|snoop probes|wasted snoops'
+same sf-96 $GEN/n96.bin "-n 96 -us 1024 -a 2" "-n 96 -us 1024 -a 2 -sf" "$SF"
+same sf-200-moesi $GEN/n200.bin "-n 200 -us 512 -a 2 -proto moesi" "-n 200 -us 512 -a 2 -proto moesi -sf" "$SF"
+
+# -j splits the sets across threads and must print what a serial run prints
+./gentrace -n 8 -r 100000 -f 16384 -s 30 -w 30 $GEN/n8.bin > /dev/null || exit 1
+./gentrace -n 8 -r 50000 -f 8192 -s 30 -t $GEN/n8.txt > /dev/null || exit 1
+J='-n 8 -us 4096 -a 4 -sf -proto moesi'
+same j3-plru $GEN/n8.bin "$J -repl plru" "$J -repl plru -j 3"
+same j4-nru $GEN/n8.txt "$J -repl nru" "$J -repl nru -j 4"
+same j3-brrip $GEN/n8.txt "$J -repl brrip" "$J -repl brrip -j 3"
+same j4-random $GEN/n8.bin "$J -repl random" "$J -repl random -j 4"
+
+# checkpoints taken mid trace, from text and binary traces
+./gentrace -n 4 -r 60000 -f 8192 -s 30 -w 30 -t $GEN/n4.txt > /dev/null || exit 1
+./tracebin $GEN/n4.txt $GEN/n4.bin > /dev/null || exit 1
+C='-n 4 -us 2048 -a 4'
+restore ckpt-txt $GEN/n4.txt 20000 "$C"
+restore ckpt-bin $GEN/n4.bin 41234 "$C"
+restore ckpt-sf-brrip $GEN/n4.txt 33333 "$C -sf -repl brrip"
+restore ckpt-cores $GEN/n4.bin 20000 "-n 4 -cores 0-1:1024,2,64 -cores 2-3:256,1,16"
+
+# batched replay must print what one reference at a time prints
+B='-n 4 -us 2048 -a 4'
+same batch $GEN/n4.txt "$B" "$B -nobatch"
+same batch-timing $GEN/n4.bin "$B -timing -classify -hot 8" "$B -timing -classify -hot 8 -nobatch"
+same batch-levels $GEN/n4.txt "$B -l2 16384 -llc 65536 -prefetch stride -timing" "$B -l2 16384 -llc 65536 -prefetch stride -timing -nobatch"
+same batch-wbuf $GEN/n4.bin "$B -wt -wbuf 4 -prefetch next -timing" "$B -wt -wbuf 4 -prefetch next -timing -nobatch"
+same batch-sample $GEN/n4.bin "$B -sample 2000,4000,10000 -sf -proto mesif" "$B -sample 2000,4000,10000 -sf -proto mesif -nobatch"
+same batch-sweep $GEN/n4.txt "-n 4 -us 1024,2048 -a 2,4 -repl brrip" "-n 4 -us 1024,2048 -a 2,4 -repl brrip -nobatch"
+same batch-roi tests/sample.test "-n 4 -sample 20,40,100 -roi" "-n 4 -sample 20,40,100 -roi -nobatch"
+
+# progress, pipeline, checkpoint and profile lines stay off the records
+parses stdout-json-p $GEN/n4.txt -n 4 -us 2048 -a 4 -stats json -p 2 -bench
+parses stdout-json-ckpt $GEN/n4.txt -n 4 -us 2048 -a 4 -stats json -ckpt 20000 -ckpt-file $GEN/ck
+parses stdout-csv-p $GEN/n4.txt -n 4 -us 2048 -a 4 -stats csv -p 2
+parses stdout-csv-ckpt $GEN/n4.bin -n 4 -us 2048 -a 4 -stats csv -ckpt 20000 -ckpt-file $GEN/ck
+
+# library handles with every model, four threads at once, must report
+# what sim reports for the same options
+./cachesim_test -list | while read opts; do
+  echo "=== $opts"
+  ./sim $opts $GEN/n4.bin | sed -n '/CACHE STATISTICS/,$p'
+done > $OUT.2
+if ./cachesim_test $GEN/n4.bin > $OUT && cmp -s $OUT.2 $OUT; then
+  echo "ok    cachesim"
+else
+  echo "FAIL  cachesim: ./cachesim_test $GEN/n4.bin"
+  diff $OUT.2 $OUT | head -20
+  fail=1
+fi
+
+rm -rf $OUT $OUT.2 $GEN
+exit $fail
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../trace.h"
+
+//Deterministic synthetic trace generator. A given pattern, seed and set of
+//parameters always yields the same trace, so runs can be compared across
+//simulator versions, e.g.
+//   gentrace -p falseshare -n 16 -r 10000000 fs16.bin
+//
+//Patterns (footprint is per region):
+//   mixed       private regions, with -s percent of references to one
+//               shared region
+//   stream      every core walks its private region word by word
+//   random      uniformly random words of one shared region
+//   prodcons    even cores write a buffer that the next odd core reads
+//               behind them
+//   falseshare  every core writes its own word of the same blocks
+//   migratory   objects are read then written by one core at a time,
+//               moving to the next core after each burst
+//   readmostly  one shared region, read by all, rarely written
+//
+//-base moves the whole trace up the address space, e.g. above 4 GB.
+
+#define PRIVATE_BASE 0x10000000u
+#define SHARED_BASE 0x80000000u
+#define WORD 4
+#define BLOCK 64		/* false sharing and migratory object granule */
+#define BURST 16		/* references per migratory visit */
+
+enum { MIXED, STREAM, RANDOM, PRODCONS, FALSESHARE, MIGRATORY, READMOSTLY, N_PATTERNS };
+static const char *pattern_names[N_PATTERNS] =
+   { "mixed", "stream", "random", "prodcons", "falseshare", "migratory", "readmostly" };
+
+static unsigned long long rng_state;
+static unsigned cores = 64, footprint = 65536, shared = 20, writes = 30;
+static unsigned long long base;	//added to every address
+static unsigned *position;	//per core word offset for stream and prodcons
+
+//xorshift64*, so a given seed always yields the same trace
+static unsigned long long rng()
+{
+   rng_state ^= rng_state >> 12;
+   rng_state ^= rng_state << 25;
+   rng_state ^= rng_state >> 27;
+   return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static void usage()
+{
+   int p;
+   printf("usage:  gentrace <options> <output trace>\n");
+   printf("\t-p <p>: \tpattern (default mixed):");
+   for(p = 0; p < N_PATTERNS; p++) printf(" %s", pattern_names[p]);
+   printf("\n");
+   printf("\t-n <n>: \tnumber of cores (default 64)\n");
+   printf("\t-r <r>: \tnumber of references (default 1000000)\n");
+   printf("\t-f <f>: \tfootprint of each region in bytes (default 65536)\n");
+   printf("\t-s <s>: \tpercent of references to shared data (default 20)\n");
+   printf("\t-w <w>: \tpercent of references that are stores (default 30)\n");
+   printf("\t-seed <s>: \trandom seed (default 1)\n");
+   printf("\t-base <b>: \tadded to every address (default 0)\n");
+   printf("\t-t: \t\twrite a text trace instead of a binary one\n");
+   exit(-1);
+}
+
+//Produces reference i of the trace
+static void next_ref(int pattern, long i, trace_record *rec)
+{
+   unsigned pid, addr, store, words = footprint / WORD, obj;
+
+   switch(pattern)
+   {
+      case MIXED:
+         pid = rng() % cores;
+         addr = (rng() % footprint) & ~(WORD - 1);
+         if(rng() % 100 < shared)
+            addr += SHARED_BASE;
+         else
+            addr += PRIVATE_BASE + pid * footprint;
+         store = rng() % 100 < writes;
+         break;
+      case STREAM:
+         pid = rng() % cores;
+         addr = PRIVATE_BASE + pid * footprint + position[pid] * WORD;
+         position[pid] = (position[pid] + 1) % words;
+         store = rng() % 100 < writes;
+         break;
+      case RANDOM:
+         pid = rng() % cores;
+         addr = SHARED_BASE + (rng() % words) * WORD;
+         store = rng() % 100 < writes;
+         break;
+      case PRODCONS:
+         //each producer/consumer pair shares one private region; the
+         //consumer trails the producer by a quarter of the buffer
+         pid = rng() % cores;
+         addr = PRIVATE_BASE + (pid & ~1u) * footprint + position[pid] * WORD;
+         position[pid] = (position[pid] + 1) % words;
+         store = !(pid & 1);
+         break;
+      case FALSESHARE:
+         pid = rng() % cores;
+         addr = SHARED_BASE + (rng() % (footprint / BLOCK)) * BLOCK + (pid * WORD) % BLOCK;
+         store = rng() % 100 < writes;
+         break;
+      case MIGRATORY:
+         //visits sweep over the objects, each round handing every object
+         //to the next core, which reads it before writing it
+         obj = (i / BURST) % (footprint / BLOCK);
+         pid = ((i / BURST) / (footprint / BLOCK) + obj) % cores;
+         addr = SHARED_BASE + obj * BLOCK + (rng() % (BLOCK / WORD)) * WORD;
+         store = i % BURST >= BURST / 2;
+         break;
+      case READMOSTLY:
+      default:
+         pid = rng() % cores;
+         addr = SHARED_BASE + (rng() % words) * WORD;
+         store = rng() % 1000 < 10;
+         break;
+   }
+
+   rec->addr = base + addr;
+   rec->pid = pid;
+   rec->access_type = store;
+}
+
+int main(int argc, char **argv)
+{
+   FILE *output;
+   trace_header header;
+   trace_record rec;
+   long refs = 1000000, i;
+   int text = 0, pattern = MIXED, arg_index;
+
+   rng_state = 1;
+   for(arg_index = 1; arg_index < argc - 1; arg_index++)
+   {
+      if(!strcmp(argv[arg_index], "-p"))
+      {
+         for(pattern = 0; pattern < N_PATTERNS && strcmp(argv[arg_index + 1], pattern_names[pattern]); pattern++);
+         if(pattern == N_PATTERNS) usage();
+         arg_index++;
+      }
+      else if(!strcmp(argv[arg_index], "-n")) cores = atoi(argv[++arg_index]);
+      else if(!strcmp(argv[arg_index], "-r")) refs = atol(argv[++arg_index]);
+      else if(!strcmp(argv[arg_index], "-f")) footprint = atoi(argv[++arg_index]);
+      else if(!strcmp(argv[arg_index], "-s")) shared = atoi(argv[++arg_index]);
+      else if(!strcmp(argv[arg_index], "-w")) writes = atoi(argv[++arg_index]);
+      else if(!strcmp(argv[arg_index], "-seed")) rng_state = strtoull(argv[++arg_index], NULL, 0);
+      else if(!strcmp(argv[arg_index], "-base")) base = strtoull(argv[++arg_index], NULL, 0);
+      else if(!strcmp(argv[arg_index], "-t")) text = 1;
+      else usage();
+   }
+   if(arg_index != argc - 1 || cores < 1 || cores > 0xffff || footprint < BLOCK || rng_state == 0)
+      usage();
+   if((unsigned long long)cores * footprint > SHARED_BASE - PRIVATE_BASE || footprint > 0xffffffffu - SHARED_BASE)
+      {printf("error : Footprint too large for the region layout\n"); exit(-1);}
+
+   position = (unsigned *)calloc(cores, sizeof(unsigned));
+   if(position == NULL) {printf("error : Memory allocation failed\n"); exit(-1);}
+   //consumers start a quarter of the buffer behind their producer
+   for(i = 1; pattern == PRODCONS && i < cores; i += 2)
+      position[i] = (footprint / WORD) - (footprint / WORD) / 4;
+
+   output = fopen(argv[argc - 1], text ? "w" : "wb");
+   if(output == NULL) {printf("error : Unable to create %s\n", argv[argc - 1]); exit(-1);}
+
+   if(!text)
+   {
+      memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+      header.version = TRACE_VERSION;
+      header.record_size = sizeof(trace_record);
+      fwrite(&header, sizeof(header), 1, output);
+   }
+
+   memset(&rec, 0, sizeof(rec));
+   for(i = 0; i < refs; i++)
+   {
+      next_ref(pattern, i, &rec);
+      if(text)
+         fprintf(output, "%u %u %llx\n", rec.pid, rec.access_type, (unsigned long long)rec.addr);
+      else
+         fwrite(&rec, sizeof(rec), 1, output);
+   }
+
+   if(fclose(output) != 0) {printf("error : Write to %s failed\n", argv[argc - 1]); exit(-1);}
+   return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../trace.h"
+
+//Converts a text trace ("core type addr" per line) into the binary trace
+//format read by the simulator, so the text parsing is paid only once.
+
+int read_trace_element(FILE *inFile, unsigned *pid, unsigned *access_type, unsigned long long *addr);
+
+int main(int argc, char **argv)
+{
+   FILE *input, *output;
+   trace_header header;
+   trace_record rec;
+   unsigned pid, access_type;
+   unsigned long long addr;
+   long records = 0;
+
+   if(argc != 3)
+   {
+      printf("usage:  tracebin <text trace> <binary trace>\n");
+      exit(-1);
+   }
+
+   input = fopen(argv[1], "r");
+   if(input == NULL) {printf("error : Unable to open %s\n", argv[1]); exit(-1);}
+   output = fopen(argv[2], "wb");
+   if(output == NULL) {printf("error : Unable to create %s\n", argv[2]); exit(-1);}
+
+   memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+   header.version = TRACE_VERSION;
+   header.record_size = sizeof(trace_record);
+   fwrite(&header, sizeof(header), 1, output);
+
+   memset(&rec, 0, sizeof(rec));
+   while(read_trace_element(input, &pid, &access_type, &addr))
+   {
+      if(pid > 0xffff || access_type > 0xff)
+      {
+         printf("error : Record %ld does not fit the binary format\n", records);
+         exit(-1);
+      }
+      rec.addr = addr;
+      rec.pid = pid;
+      rec.access_type = access_type;
+      if(fwrite(&rec, sizeof(rec), 1, output) != 1)
+         {printf("error : Write to %s failed\n", argv[2]); exit(-1);}
+      records++;
+   }
+
+   fclose(input);
+   if(fclose(output) != 0) {printf("error : Write to %s failed\n", argv[2]); exit(-1);}
+   printf("%ld records written to %s\n", records, argv[2]);
+   return 0;
+}
+
+
+/************************************************************/
+/* same parsing as the simulator's text reader */
+int read_trace_element(FILE *inFile, unsigned *pid, unsigned *access_type, unsigned long long *addr)
+{
+  int result;
+  char c;
+
+  result = fscanf(inFile, "%u %u %llx%c", pid, access_type, addr, &c);
+  while (c != '\n') {
+    result = fscanf(inFile, "%c", &c);
+    if (result == EOF)
+      break;
+  }
+  if (result != EOF)
+    return(1);
+  else
+    return(0);
+}
+/************************************************************/
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "timing.h"
+#include "wbuf.h"
+
+/* Per thread, like the model of cache.c; see wbuf_save() */
+static __thread int entries;		/* per core */
+static __thread int num_core;
+static __thread int timed;
+
+/* entries of core pid are pid * entries .., oldest first */
+static __thread unsigned long long *blocks;
+static __thread unsigned long long *masks;	/* words stored to each entry */
+static __thread int *used;		/* entries in use per core */
+static __thread long buffered;		/* entries in use on all cores */
+
+/************************************************************/
+/* returns why blocks of block_size bytes cannot be buffered, NULL if they
+   can */
+char *wbuf_error(int block_size)
+{
+  static __thread char error_text[80];
+
+  if (block_size / WORD_SIZE <= MAX_WBUF_WORDS)
+    return NULL;
+  snprintf(error_text, sizeof(error_text), "the write buffer needs blocks of at most %d bytes",
+           MAX_WBUF_WORDS * WORD_SIZE);
+  return error_text;
+}
+
+void wbuf_init(int n, int n_cores, int block_size, int timing)
+{
+  char *msg = wbuf_error(block_size);
+
+  if (msg != NULL) {
+    printf("error : %s\n", msg);
+    exit(-1);
+  }
+  entries = n;
+  num_core = n_cores;
+  timed = timing;
+  buffered = 0;
+
+  blocks = (unsigned long long *)calloc((size_t)n_cores * n, sizeof(unsigned long long));
+  masks = (unsigned long long *)calloc((size_t)n_cores * n, sizeof(unsigned long long));
+  used = (int *)calloc(n_cores, sizeof(int));
+  if (blocks == NULL || masks == NULL || used == NULL) {
+    printf("error : Memory allocation failed for the write buffers\n");
+    exit(-1);
+  }
+}
+/************************************************************/
+
+/************************************************************/
+/* writes entry e of pid to memory and closes the gap it leaves */
+static void drain(unsigned pid, int e)
+{
+  unsigned long long *b = &blocks[(size_t)pid * entries];
+  unsigned long long *m = &masks[(size_t)pid * entries];
+  Pcache_stat st = core_stats(pid);
+  int words = __builtin_popcountll(m[e]);
+
+  st->write_words += words;
+  st->write_transactions++;
+  if (timed)
+    timing_write_through(words, FALSE);
+
+  used[pid]--;
+  buffered--;
+  memmove(&b[e], &b[e + 1], (used[pid] - e) * sizeof(unsigned long long));
+  memmove(&m[e], &m[e + 1], (used[pid] - e) * sizeof(unsigned long long));
+}
+
+void wbuf_store(unsigned long long block, unsigned word, unsigned pid)
+{
+  unsigned long long *b = &blocks[(size_t)pid * entries];
+  unsigned long long *m = &masks[(size_t)pid * entries];
+  int e;
+
+  for (e = 0; e < used[pid]; e++)
+    if (b[e] == block) {
+      m[e] |= 1ULL << word;
+      return;
+    }
+
+  if (used[pid] == entries)
+    drain(pid, 0);
+  b[used[pid]] = block;
+  m[used[pid]] = 1ULL << word;
+  used[pid]++;
+  buffered++;
+}
+
+/* pid misses on block: the other cores' entries for it drain, and its own
+   if own is set */
+void wbuf_snoop(unsigned long long block, unsigned pid, int own)
+{
+  unsigned long long *b;
+  int i, e;
+
+  if (!buffered)
+    return;
+  for (i = 0; i < num_core; i++) {
+    if (i == (int)pid && !own)
+      continue;
+    b = &blocks[(size_t)i * entries];
+    for (e = 0; e < used[i]; e++)
+      if (b[e] == block) {
+        drain(i, e);
+        break;
+      }
+  }
+}
+
+void wbuf_flush()
+{
+  int i;
+
+  for (i = 0; i < num_core; i++)
+    while (used[i])
+      drain(i, 0);
+}
+/************************************************************/
+
+/************************************************************/
+void print_wbuf_stats()
+{
+  int i;
+  Pcache_stat st;
+  cache_stat t;
+
+  memset(&t, 0, sizeof(t));
+  printf("\n");
+  printf("  WRITE BUFFER (%d entries)\n", entries);
+  for (i = 0; i < num_core; i++) {
+    st = core_stats(i);
+    printf("  CORE %d: stores %lld, words written %lld, transactions %lld\n", i,
+           st->write_throughs, st->write_words, st->write_transactions);
+    t.write_throughs += st->write_throughs;
+    t.write_words += st->write_words;
+    t.write_transactions += st->write_transactions;
+  }
+  printf("  coalesced stores:     %lld\n", t.write_throughs - t.write_transactions);
+  printf("  write transactions:   %lld\n", t.write_transactions);
+  printf("  words per transaction: %f\n",
+         t.write_transactions ? (double)t.write_words / t.write_transactions : 0.0);
+}
+/************************************************************/
+
+/************************************************************/
+/* copies the write buffers of this thread into ctx, wbuf_load() puts them
+   back */
+void wbuf_save(wbuf_context *ctx)
+{
+  ctx->entries = entries;
+  ctx->num_core = num_core;
+  ctx->timed = timed;
+  ctx->blocks = blocks;
+  ctx->masks = masks;
+  ctx->used = used;
+  ctx->buffered = buffered;
+}
+
+void wbuf_load(wbuf_context *ctx)
+{
+  entries = ctx->entries;
+  num_core = ctx->num_core;
+  timed = ctx->timed;
+  blocks = ctx->blocks;
+  masks = ctx->masks;
+  used = ctx->used;
+  buffered = ctx->buffered;
+}
+
+void wbuf_free(wbuf_context *ctx)
+{
+  free(ctx->blocks);
+  free(ctx->masks);
+  free(ctx->used);
+}
+/************************************************************/
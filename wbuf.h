@@ -0,0 +1,28 @@
+/* Coalescing write buffer between each core and memory, for the stores
+   that go to memory under -wt or -nw. Each of a core's entries collects
+   the words stored to one block. A store to a block already buffered
+   merges into its entry, otherwise it takes a free entry, the oldest
+   entry draining first if there is none. An entry drains as one bus
+   transaction carrying the distinct words stored to it. A miss by any
+   core on a buffered block drains its entries first, so the fill reads
+   memory with the stores applied; only a write around by the same core
+   keeps coalescing. flush() drains the rest. */
+#define MAX_WBUF_WORDS 64	/* words a block may have, one bit each */
+
+/* the write buffers of one cache_context, see save_context() */
+typedef struct wbuf_context_ {
+  int entries, num_core, timed;
+  unsigned long long *blocks, *masks;
+  int *used;
+  long buffered;
+} wbuf_context;
+
+char *wbuf_error(int block_size);
+void wbuf_init(int entries, int n_cores, int block_size, int timed);
+void wbuf_store(unsigned long long block, unsigned word, unsigned pid);
+void wbuf_snoop(unsigned long long block, unsigned pid, int own);
+void wbuf_flush();
+void print_wbuf_stats();
+void wbuf_save(wbuf_context *ctx);
+void wbuf_load(wbuf_context *ctx);
+void wbuf_free(wbuf_context *ctx);